@@ -29,8 +29,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <queue>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <stdint.h>
 #include <condition_variable>
 
+// Blocking consumers spin on a lock-free element count for a short, adaptive
+// number of iterations before parking on the condition variable. The spin budget
+// grows when spinning pays off (bursty producers) and shrinks when it doesn't.
 template<typename T>
 class ConcurrentQueue
 {
@@ -39,16 +47,129 @@ class ConcurrentQueue
     mutable std::mutex mutex;
     std::condition_variable condition;
 
+    std::atomic<size_t> count;
+    std::atomic<uint32_t> spinBudget;
+    std::atomic<uint32_t> maxSpin; // may be changed while consumers spin
+    int parkedWaiters = 0;
+
+    static const uint32_t minSpin = 16;
+
+    // Called with the lock held
+    void notify_locked(size_t n)
+    {
+        if (parkedWaiters == 0) return;
+        if (n == 1) condition.notify_one();
+        else condition.notify_all();
+    }
+
+    // Called with the lock held
+    template<typename Container>
+    size_t drain_locked(Container & out, size_t max)
+    {
+        size_t n = 0;
+        while (!queue.empty() && n < max)
+        {
+            out.push_back(std::move(queue.front()));
+            queue.pop();
+            ++n;
+        }
+        count.store(queue.size(), std::memory_order_release);
+        return n;
+    }
+
+    // Returns true if an element became visible while spinning
+    bool adaptive_spin()
+    {
+        const uint32_t budget = spinBudget.load(std::memory_order_relaxed);
+        const uint32_t limit = maxSpin.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < budget; ++i)
+        {
+            if (count.load(std::memory_order_acquire) != 0)
+            {
+                if (budget < limit) spinBudget.store(std::min(limit, budget * 2), std::memory_order_relaxed);
+                return true;
+            }
+            if ((i & 63) == 63) std::this_thread::yield();
+        }
+        if (budget > minSpin) spinBudget.store(std::min(limit, std::max(uint32_t(minSpin), budget / 2)), std::memory_order_relaxed);
+        return false;
+    }
+
+    // Blocks (spin, then park) until the queue is non-empty or the deadline passes. Called with the lock held.
+    template<typename Clock, typename Duration>
+    bool wait_locked(std::unique_lock<std::mutex> & lock, const std::chrono::time_point<Clock, Duration> * deadline)
+    {
+        if (!queue.empty()) return true;
+
+        lock.unlock();
+        adaptive_spin();
+        lock.lock();
+
+        while (queue.empty())
+        {
+            ++parkedWaiters;
+            if (deadline)
+            {
+                const bool timedOut = (condition.wait_until(lock, *deadline) == std::cv_status::timeout);
+                --parkedWaiters;
+                if (timedOut) return !queue.empty();
+            }
+            else
+            {
+                condition.wait(lock);
+                --parkedWaiters;
+            }
+        }
+        return true;
+    }
+
+    void pop_locked(T & popped_value)
+    {
+        popped_value = std::move(queue.front());
+        queue.pop();
+        count.store(queue.size(), std::memory_order_release);
+    }
+
 public:
 
-    ConcurrentQueue(void) {};
+    ConcurrentQueue(void) : count(0), spinBudget(256), maxSpin(4096) {};
     ~ConcurrentQueue(void) {};
 
+    // Upper bound on the number of spin iterations before a waiting consumer parks.
+    // Zero disables spinning entirely.
+    void set_max_spin(uint32_t iterations)
+    {
+        maxSpin.store(iterations, std::memory_order_relaxed);
+        spinBudget.store(std::min(spinBudget.load(std::memory_order_relaxed), iterations), std::memory_order_relaxed);
+    }
+
     void push(T const& pushed_value)
     {
         std::lock_guard<std::mutex> lock(mutex);
         queue.push(pushed_value);
-        condition.notify_one();
+        count.store(queue.size(), std::memory_order_release);
+        notify_locked(1);
+    }
+
+    void push(T && pushed_value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push(std::move(pushed_value));
+        count.store(queue.size(), std::memory_order_release);
+        notify_locked(1);
+    }
+
+    // Pushes a range of elements under a single lock acquisition
+    template<typename InputIterator>
+    void push_bulk(InputIterator first, InputIterator last)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t n = 0;
+        for (; first != last; ++first, ++n)
+            queue.push(*first);
+        if (n == 0) return;
+        count.store(queue.size(), std::memory_order_release);
+        notify_locked(n);
     }
 
     bool empty() const
@@ -65,24 +186,65 @@ public:
             return false;
         }
 
-        popped_value = queue.front();
-        queue.pop();
+        pop_locked(popped_value);
         return true;
     }
 
     void wait_and_pop(T & popped_value)
     {
         std::unique_lock<std::mutex> lock(mutex);
-        while (queue.empty())
-        {
-            condition.wait(lock);
-        }
+        wait_locked<std::chrono::steady_clock, std::chrono::steady_clock::duration>(lock, nullptr);
+        pop_locked(popped_value);
+    }
 
-        popped_value = queue.front();
-        queue.pop();
+    // Returns false if nothing arrived before the timeout expired
+    template<typename Rep, typename Period>
+    bool wait_for(T & popped_value, const std::chrono::duration<Rep, Period> & timeout)
+    {
+        return wait_until(popped_value, std::chrono::steady_clock::now() + timeout);
     }
 
-    std::size_t size() const { return queue.size(); }
+    template<typename Clock, typename Duration>
+    bool wait_until(T & popped_value, const std::chrono::time_point<Clock, Duration> & deadline)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!wait_locked(lock, &deadline)) return false;
+        pop_locked(popped_value);
+        return true;
+    }
+
+    // Moves up to max elements into out (via push_back) without blocking. Returns the number moved.
+    template<typename Container>
+    size_t drain_into(Container & out, size_t max = std::numeric_limits<size_t>::max())
+    {
+        if (count.load(std::memory_order_acquire) == 0) return 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        return drain_locked(out, max);
+    }
+
+    // Blocks until at least one element is available, then drains up to max in the same wakeup
+    template<typename Container>
+    size_t wait_and_drain_into(Container & out, size_t max = std::numeric_limits<size_t>::max())
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wait_locked<std::chrono::steady_clock, std::chrono::steady_clock::duration>(lock, nullptr);
+        return drain_locked(out, max);
+    }
+
+    template<typename Container, typename Rep, typename Period>
+    size_t wait_for_and_drain_into(Container & out, const std::chrono::duration<Rep, Period> & timeout, size_t max = std::numeric_limits<size_t>::max())
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!wait_locked(lock, &deadline)) return 0;
+        return drain_locked(out, max);
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
 
 };
 
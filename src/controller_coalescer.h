@@ -0,0 +1,188 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_CONTROLLER_COALESCER_H
+#define MODERNMIDI_CONTROLLER_COALESCER_H
+
+#include "midi_message.h"
+
+#include <vector>
+#include <limits>
+#include <cstring>
+#include <stdint.h>
+
+namespace mm
+{
+
+// Rate-caps continuous controller streams: control change, poly pressure, pitch bend and
+// channel pressure. Each (channel, controller) slot passes at most one message per window.
+// The first change after a quiet window goes through immediately; changes inside the
+// window replace each other, and only the latest value is emitted once the window ends.
+//
+// Every other message passes through untouched and in order. Before a note or program
+// change, the held values of that channel are emitted first, so a note always sees the
+// controller state that preceded it. Held values only leave on the next process() or
+// flushDue() call, so whoever owns the coalescer has to call flushDue() to deliver the
+// tail of a burst when the input goes quiet. Not thread-safe.
+class ControllerCoalescer
+{
+public:
+
+    // Number of (channel, controller) slots, and so the most values that can be held at once
+    static const size_t SlotCount = 16 * 128 * 2 + 16 * 2;
+
+private:
+
+    struct Slot
+    {
+        MidiNanos lastEmit = std::numeric_limits<MidiNanos>::min() / 2; // long ago, without overflowing now - lastEmit
+        MidiNanos timestamp = 0;
+        MidiNanos delta = 0;
+        uint8_t data[3];
+        uint8_t size = 0;
+        bool held = false;
+    };
+
+    MidiNanos window;
+    std::vector<Slot> slots;
+    std::vector<uint16_t> heldSlots; // in the order they were first held
+    uint64_t coalesced = 0;
+
+    // Control change, then poly pressure, then pitch bend, then channel pressure
+    static int slotIndex(const MidiMessageView & msg)
+    {
+        const uint8_t type = msg.data[0] & 0xF0, channel = msg.data[0] & 0x0F;
+        const uint8_t number = (msg.size > 1) ? (msg.data[1] & 0x7F) : 0;
+        switch (type)
+        {
+            case 0xB0: return channel * 128 + number;
+            case 0xA0: return 16 * 128 + channel * 128 + number;
+            case 0xE0: return 16 * 128 * 2 + channel;
+            case 0xD0: return 16 * 128 * 2 + 16 + channel;
+            default: return -1;
+        }
+    }
+
+    template<typename Emit>
+    void emitSlot(Slot & s, MidiNanos now, Emit & emit)
+    {
+        s.held = false;
+        s.lastEmit = now;
+        emit(MidiMessageView(s.data, s.size, s.timestamp, s.delta));
+    }
+
+    // Emits held slots matching `pick`, keeping the rest in order
+    template<typename Pick, typename Emit>
+    size_t flushWhere(Pick pick, MidiNanos now, Emit & emit)
+    {
+        size_t kept = 0, emitted = 0;
+        for (size_t i = 0; i < heldSlots.size(); ++i)
+        {
+            Slot & s = slots[heldSlots[i]];
+            if (pick(s))
+            {
+                emitSlot(s, now, emit);
+                ++emitted;
+            }
+            else heldSlots[kept++] = heldSlots[i];
+        }
+        heldSlots.resize(kept);
+        return emitted;
+    }
+
+public:
+
+    ControllerCoalescer(MidiNanos window) : window(window), slots(SlotCount)
+    {
+        heldSlots.reserve(SlotCount);
+    }
+
+    MidiNanos getWindow() const { return window; }
+
+    // Messages replaced by a later value in the same slot and never emitted
+    uint64_t getCoalescedCount() const { return coalesced; }
+
+    // Feeds one message stamped on the MonotonicNanos() timebase; emit(const MidiMessageView &)
+    // is called for everything that should be delivered now, in order
+    template<typename Emit>
+    void process(const MidiMessageView & msg, Emit && emit)
+    {
+        const MidiNanos now = msg.timestamp;
+        flushDue(now, emit);
+
+        if (msg.size == 0 || msg.data[0] >= 0xF0)
+        {
+            emit(msg);
+            return;
+        }
+
+        const int index = (msg.size <= 3) ? slotIndex(msg) : -1;
+        if (index < 0)
+        {
+            const uint8_t channel = msg.data[0] & 0x0F;
+            flushWhere([channel](const Slot & s) { return (s.data[0] & 0x0F) == channel; }, now, emit);
+            emit(msg);
+            return;
+        }
+
+        Slot & s = slots[index];
+        if (s.held) ++coalesced;
+        else if (now - s.lastEmit >= window)
+        {
+            s.lastEmit = now;
+            emit(msg);
+            return;
+        }
+        else heldSlots.push_back(uint16_t(index));
+
+        std::memcpy(s.data, msg.data, msg.size);
+        s.size = uint8_t(msg.size);
+        s.timestamp = msg.timestamp;
+        s.delta = msg.delta;
+        s.held = true;
+    }
+
+    // Emits held values whose window has ended by `now`. Returns how many.
+    template<typename Emit>
+    size_t flushDue(MidiNanos now, Emit && emit)
+    {
+        if (heldSlots.empty()) return 0;
+        const MidiNanos w = window;
+        return flushWhere([now, w](const Slot & s) { return now - s.lastEmit >= w; }, now, emit);
+    }
+
+    // Emits every held value regardless of the window
+    template<typename Emit>
+    size_t flush(MidiNanos now, Emit && emit)
+    {
+        return flushWhere([](const Slot &) { return true; }, now, emit);
+    }
+};
+
+} // mm
+
+#endif
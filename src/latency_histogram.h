@@ -0,0 +1,154 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_LATENCY_HISTOGRAM_H
+#define MODERNMIDI_LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <algorithm>
+#include <stdint.h>
+
+namespace mm
+{
+
+struct LatencySnapshot
+{
+    uint64_t count = 0;
+    int64_t p50 = 0;    // all values in nanoseconds
+    int64_t p99 = 0;
+    int64_t p999 = 0;
+    int64_t max = 0;
+    double mean = 0;
+};
+
+// Log-linear (HDR-style) histogram of nanosecond durations. Every power of two is split
+// into 2^SubBucketBits linear sub-buckets, giving ~3% relative precision from 1 ns up to
+// the full 64-bit range in a fixed ~16 KB table. record() is wait-free and may be called
+// from a real-time thread while other threads take snapshots.
+class LatencyHistogram
+{
+    static const int SubBucketBits = 5;
+    static const uint64_t SubBucketCount = uint64_t(1) << SubBucketBits;
+    static const size_t BucketCount = (64 - SubBucketBits + 1) * SubBucketCount;
+
+    std::atomic<uint64_t> counts[BucketCount];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> maxValue;
+
+    static int msb(uint64_t v)
+    {
+        int r = 0;
+        while (v >>= 1) ++r;
+        return r;
+    }
+
+    static size_t indexFor(uint64_t v)
+    {
+        if (v < SubBucketCount) return size_t(v);
+        const int shift = msb(v) - SubBucketBits;
+        const uint64_t mantissa = v >> shift; // in [SubBucketCount, 2 * SubBucketCount)
+        return size_t((uint64_t(shift) + 1) * SubBucketCount + (mantissa - SubBucketCount));
+    }
+
+    // Highest value that maps to the bucket, so percentiles never under-report
+    static uint64_t valueFor(size_t idx)
+    {
+        if (idx < SubBucketCount) return idx;
+        const uint64_t shift = idx / SubBucketCount - 1;
+        const uint64_t mantissa = idx % SubBucketCount + SubBucketCount;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+public:
+
+    LatencyHistogram() { reset(); }
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram & operator = (const LatencyHistogram &) = delete;
+
+    // Negative durations (early) are recorded as zero
+    void record(int64_t nanoseconds)
+    {
+        const uint64_t v = nanoseconds > 0 ? uint64_t(nanoseconds) : 0;
+        counts[indexFor(v)].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(v, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t prev = maxValue.load(std::memory_order_relaxed);
+        while (v > prev && !maxValue.compare_exchange_weak(prev, v, std::memory_order_relaxed)) {}
+    }
+
+    // Not atomic with respect to concurrent record() calls; a racing sample may be lost
+    void reset()
+    {
+        for (auto & c : counts) c.store(0, std::memory_order_relaxed);
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        maxValue.store(0, std::memory_order_relaxed);
+    }
+
+    LatencySnapshot snapshot() const
+    {
+        LatencySnapshot s;
+
+        uint64_t local[BucketCount];
+        uint64_t n = 0;
+        for (size_t i = 0; i < BucketCount; ++i)
+        {
+            local[i] = counts[i].load(std::memory_order_relaxed);
+            n += local[i];
+        }
+
+        s.count = n;
+        s.max = int64_t(maxValue.load(std::memory_order_relaxed));
+        if (n == 0) return s;
+
+        s.mean = double(sum.load(std::memory_order_relaxed)) / double(total.load(std::memory_order_relaxed));
+
+        const uint64_t r50 = (n * 50 + 99) / 100;
+        const uint64_t r99 = (n * 99 + 99) / 100;
+        const uint64_t r999 = (n * 999 + 999) / 1000;
+
+        uint64_t seen = 0;
+        bool have50 = false, have99 = false;
+        for (size_t i = 0; i < BucketCount; ++i)
+        {
+            if (local[i] == 0) continue;
+            seen += local[i];
+            const int64_t value = std::min<int64_t>(int64_t(valueFor(i)), s.max);
+            if (!have50 && seen >= r50) { s.p50 = value; have50 = true; }
+            if (!have99 && seen >= r99) { s.p99 = value; have99 = true; }
+            if (seen >= r999) { s.p999 = value; break; }
+        }
+        return s;
+    }
+};
+
+} // mm
+
+#endif
@@ -0,0 +1,222 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "midi_clock.h"
+
+#include <cmath>
+
+using namespace mm;
+
+MidiClockFollower::MidiClockFollower(double bandwidthHz, SequencerClock * clock) : clock(clock ? clock : &platformClock), origin(this->clock->now()), bandwidth(bandwidthHz), period(60.0 / 120.0 / ClocksPerBeat), 
+    sequence(0), pubTick(0), pubT0(0), pubT1(0), pubPeriod(0), pubRunning(false), pubGeneration(0)
+{
+    publish();
+}
+
+void MidiClockFollower::publish()
+{
+    sequence.fetch_add(1, std::memory_order_acq_rel); // odd: write in progress
+    pubTick.store(tick, std::memory_order_relaxed);
+    pubT0.store(t0, std::memory_order_relaxed);
+    pubT1.store(t1, std::memory_order_relaxed);
+    pubPeriod.store(period, std::memory_order_relaxed);
+    pubRunning.store(running, std::memory_order_relaxed);
+    pubGeneration.store(generation, std::memory_order_relaxed);
+    sequence.fetch_add(1, std::memory_order_release);
+}
+
+MidiClockFollower::State MidiClockFollower::read() const
+{
+    State s;
+    uint32_t before, after;
+    do
+    {
+        before = sequence.load(std::memory_order_acquire);
+        s.tick = pubTick.load(std::memory_order_relaxed);
+        s.t0 = pubT0.load(std::memory_order_relaxed);
+        s.t1 = pubT1.load(std::memory_order_relaxed);
+        s.period = pubPeriod.load(std::memory_order_relaxed);
+        s.running = pubRunning.load(std::memory_order_relaxed);
+        s.generation = pubGeneration.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return s;
+}
+
+void MidiClockFollower::resetLoop(double now)
+{
+    // Coefficients from the loop bandwidth, as in Adriaensen's "Using a DLL to filter time"
+    const double omega = 2.0 * MM_PI * bandwidth * period;
+    b = MM_SQRT2 * omega;
+    c = omega * omega;
+    t0 = now;
+    t1 = now + period;
+}
+
+void MidiClockFollower::handleMessage(const MidiMessageView & msg)
+{
+    handleMessage(msg, msg.timestamp ? msg.timestamp : clock->now());
+}
+
+void MidiClockFollower::handleMessage(const MidiMessageView & msg, MidiNanos timestamp)
+{
+    if (msg.messageSize() == 0) return;
+
+    const double time = secondsAt(timestamp);
+
+    switch (msg.getMessageType())
+    {
+        case MessageType::TIME_CLOCK:
+        {
+            if (armed)
+            {
+                // First clock after START / CONTINUE marks the current position
+                armed = false;
+                running = true;
+                resetLoop(time);
+                break;
+            }
+
+            const double e = time - t1;
+
+            // A gap of several periods means the master paused or we dropped clocks
+            if (std::fabs(e) > 4.0 * period)
+            {
+                if (running) tick += int64_t(std::floor((time - t0) / period + 0.5));
+                resetLoop(time);
+                break;
+            }
+
+            t0 = t1;
+            t1 += b * e + period;
+            period += c * e;
+
+            if (running) ++tick;
+            break;
+        }
+        case MessageType::START:
+            tick = 0;
+            armed = true;
+            running = false;
+            ++generation;
+            break;
+        case MessageType::CONTINUE:
+            armed = true;
+            running = false;
+            ++generation;
+            break;
+        case MessageType::STOP:
+            armed = false;
+            running = false;
+            break;
+        case MessageType::SONG_POS_POINTER:
+        {
+            if (msg.messageSize() < 3) return;
+            // Song position is counted in MIDI beats (sixteenth notes = 6 clocks)
+            tick = int64_t((msg[1] & 0x7F) | ((msg[2] & 0x7F) << 7)) * 6;
+            ++generation;
+            break;
+        }
+        default: return;
+    }
+
+    publish();
+}
+
+bool MidiClockFollower::isRunning() const
+{
+    return pubRunning.load(std::memory_order_acquire);
+}
+
+double MidiClockFollower::beatPositionAt(MidiNanos timestamp) const
+{
+    const double t = secondsAt(timestamp);
+    const State s = read();
+    double fraction = 0;
+    if (s.running && s.t1 > s.t0)
+        fraction = mm::clamp((t - s.t0) / (s.t1 - s.t0), 0.0, 1.0);
+    return (double(s.tick) + fraction) / ClocksPerBeat;
+}
+
+double MidiClockFollower::beatsPerMinute() const
+{
+    const State s = read();
+    if (s.period <= 0) return 0;
+    return 60.0 / (s.period * ClocksPerBeat);
+}
+
+MidiClockGenerator::MidiClockGenerator(MidiOutput & output) : output(output), 
+    clockMsg(std::vector<uint8_t>{ uint8_t(MessageType::TIME_CLOCK) }),
+    startMsg(std::vector<uint8_t>{ uint8_t(MessageType::START) }),
+    continueMsg(std::vector<uint8_t>{ uint8_t(MessageType::CONTINUE) }),
+    stopMsg(std::vector<uint8_t>{ uint8_t(MessageType::STOP) }),
+    songPositionMsg(SongPositionMetaEvent(0))
+{
+    relocate[0] = &songPositionMsg;
+    relocate[1] = &continueMsg;
+
+}
+
+void MidiClockGenerator::sendOne(const MidiMessage & msg)
+{
+    output.send(msg);
+}
+
+void MidiClockGenerator::start(double beat)
+{
+    if (running) stop();
+
+    // Song position pointer has sixteenth-note (6 clock) resolution and 14 bits of range
+    const int sixteenths = mm::clamp(int(std::ceil(beat * 4.0 - 1e-9)), 0, 0x3FFF);
+    nextClock = int64_t(sixteenths) * 6;
+
+    if (sixteenths == 0)
+    {
+        sendOne(startMsg);
+    }
+    else
+    {
+        songPositionMsg.data[1] = uint8_t(sixteenths & 127);
+        songPositionMsg.data[2] = uint8_t((sixteenths >> 7) & 127);
+        output.sendBatch(relocate, 2);
+    }
+
+    running = true;
+}
+
+void MidiClockGenerator::stop()
+{
+    if (!running) return;
+    sendOne(stopMsg);
+    running = false;
+}
+
+void MidiClockGenerator::sendClock(MidiNanos late)
+{
+    sendOne(clockMsg);
+    lateness.record(late);
+    ++nextClock;
+}
@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_CLOCK_H
+#define MODERNMIDI_CLOCK_H
+
+#include "modernmidi.h"
+#include "midi_message.h"
+#include "midi_time.h"
+#include "midi_output.h"
+#include "latency_histogram.h"
+#include "sequencer_clock.h"
+
+#include <atomic>
+
+namespace mm
+{
+
+const int ClocksPerBeat = 24;
+
+// Tracks tempo and song position of an external MIDI clock master (0xF8 clock, START,
+// CONTINUE, STOP and SONG_POS_POINTER). Clock arrival times are smoothed by a second
+// order delay-locked loop, so the reported position advances continuously between ticks
+// and never runs more than one tick ahead of the last clock received.
+//
+// Feed it from exactly one thread (typically a MidiInput callback; remember that RtMidi
+// ignores timing messages unless ignoreTypes(..., false, ...) is called). Any thread may
+// query it: state is published through a seqlock. All times are on the follower's clock,
+// which must be the one the consuming player runs on.
+class MidiClockFollower
+{
+    PlatformSequencerClock platformClock;
+    SequencerClock * clock;
+
+    MidiNanos origin; // DLL state is in seconds since construction
+
+    double secondsAt(MidiNanos t) const { return NanosToSeconds(t - origin); }
+
+    // Writer-side DLL state
+    double bandwidth;
+    double b = 0, c = 0;
+    double t0 = 0, t1 = 0, period;
+    int64_t tick = 0;
+    bool armed = false;
+    bool running = false;
+    uint32_t generation = 0;
+
+    // Published state
+    std::atomic<uint32_t> sequence;
+    std::atomic<int64_t> pubTick;
+    std::atomic<double> pubT0, pubT1, pubPeriod;
+    std::atomic<bool> pubRunning;
+    std::atomic<uint32_t> pubGeneration;
+
+    void publish();
+    void resetLoop(double now);
+
+    struct State { int64_t tick; double t0, t1, period; bool running; uint32_t generation; };
+    State read() const;
+
+public:
+
+    // bandwidthHz trades tracking speed for smoothness; 0.5-2 Hz suits most hardware.
+    // nullptr (the default) uses the hardware timer, which MidiInput timestamps are on.
+    MidiClockFollower(double bandwidthHz = 1.0, SequencerClock * clock = nullptr);
+
+    // Uses the message's arrival timestamp (as set by MidiInput), or the clock's now() if it has none
+    void handleMessage(const MidiMessageView & msg);
+
+    // time must be on the follower's clock
+    void handleMessage(const MidiMessageView & msg, MidiNanos time);
+
+    bool isRunning() const;
+
+    // Quarter notes since the start of the song at time t (the clock's now() by default)
+    double beatPosition() const { return beatPositionAt(clock->now()); }
+    double beatPositionAt(MidiNanos t) const;
+
+    // Smoothed master tempo
+    double beatsPerMinute() const;
+
+    // Incremented whenever the master relocates (START, CONTINUE, SONG_POS_POINTER), so
+    // followers know to re-chase rather than treat the jump as lateness
+    uint32_t positionGeneration() const { return pubGeneration.load(std::memory_order_acquire); }
+};
+
+// Generates 24 PPQN clock and the START / CONTINUE / STOP / SONG_POS_POINTER transport
+// messages for external slaves. It does no timing of its own: the owner (normally the
+// sequencer thread) polls nextClockBeat() and calls sendClock() once that beat is reached.
+// Clock n is always due at exactly beat n / 24, so rounding never accumulates into drift.
+class MidiClockGenerator
+{
+    MidiOutput & output;
+    int64_t nextClock = 0;
+    bool running = false;
+    LatencyHistogram lateness;
+
+    const MidiMessage clockMsg;
+    const MidiMessage startMsg;
+    const MidiMessage continueMsg;
+    const MidiMessage stopMsg;
+
+    // SONG_POS_POINTER + CONTINUE, rewritten in place so relocating doesn't allocate
+    MidiMessage songPositionMsg;
+    const MidiMessage * relocate[2];
+
+    void sendOne(const MidiMessage & msg);
+
+public:
+
+    explicit MidiClockGenerator(MidiOutput & output);
+
+    // Positions slaves at the first sixteenth note at or after `beat`: START when that is
+    // zero, otherwise SONG_POS_POINTER followed by CONTINUE. Sends STOP first if running.
+    void start(double beat);
+    void stop();
+    bool isRunning() const { return running; }
+
+    // Beat (quarter notes) at which the next clock is due
+    double nextClockBeat() const { return double(nextClock) / ClocksPerBeat; }
+
+    // Sends the pending clock; late is how far past its deadline it actually went out
+    void sendClock(MidiNanos late);
+
+    // Distribution of clock lateness against the ideal grid; p99 - p50 is the jitter slaves see
+    LatencySnapshot getJitter() const { return lateness.snapshot(); }
+    void resetJitter() { lateness.reset(); }
+};
+
+} // mm
+
+#endif
@@ -40,8 +40,10 @@ namespace mm
 
     struct MidiPlayerEvent
     {
-        MidiPlayerEvent(double t,std::shared_ptr<MidiMessage> m, int track) : timestamp(t), trackIdx(track), msg(m) {}
-        double timestamp;
+        MidiPlayerEvent(MidiNanos t,std::shared_ptr<MidiMessage> m, int track) : timestamp(t), trackIdx(track), msg(m) {}
+        MidiPlayerEvent(MidiNanos t, MidiTick tick, std::shared_ptr<MidiMessage> m, int track) : timestamp(t), tick(tick), trackIdx(track), msg(m) {}
+        MidiNanos timestamp; // at the tempo the sequence was loaded with
+        MidiTick tick = 0; // absolute position in the sequence, which is what playback schedules against
         int trackIdx;
         std::shared_ptr<MidiMessage> msg;
     };
@@ -57,10 +59,10 @@ namespace mm
 
     struct TrackEvent
     {
-        int tick = 0;
+        MidiTick tick = 0;
         int track = 0;
         std::shared_ptr<MidiMessage> m;
-        TrackEvent(int tick, int track, std::shared_ptr<MidiMessage> m) : tick(tick), track(track), m(m) { }
+        TrackEvent(MidiTick tick, int track, std::shared_ptr<MidiMessage> m) : tick(tick), track(track), m(m) { }
         TrackEvent(TrackEvent && r) { *this = std::move(r); }
         TrackEvent & operator = (TrackEvent && r) { tick = r.tick; track = r.track; m = std::move(r.m); return *this; }
         virtual ~TrackEvent() {};
@@ -44,14 +44,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace mm 
 {
 
-TrackEvent * parseEvent(int tick, int track, uint8_t const *& dataStart, MessageType lastEventTypeByte)
+TrackEvent * parseEvent(MidiTick tick, int track, uint8_t const *& dataStart, MessageType lastEventTypeByte)
 {
     MessageType type = (MessageType) *dataStart++;
         
     auto m = std::make_shared<MidiMessage>();
     TrackEvent * event = new TrackEvent(tick, track, m);
 
-    if (((uint8_t) type & 0xF) == 0xF) 
+    if (((uint8_t) type & 0xF0) == 0xF0) 
     {
         // Meta event 
         if ((uint8_t) type == 0xFF) 
@@ -133,7 +133,9 @@ TrackEvent * parseEvent(int tick, int track, uint8_t const *& dataStart, Message
 
         else if (type == MessageType::SYSTEM_EXCLUSIVE) 
         {
+            // Keep the status byte so the message round-trips through MidiFileWriter
             int length = read_variable_length(dataStart);
+            event->m->data.assign(1, (uint8_t) type);
             read_bytes(event->m->data, dataStart, length);
             return event;
         }
@@ -141,6 +143,7 @@ TrackEvent * parseEvent(int tick, int track, uint8_t const *& dataStart, Message
         else if (type == MessageType::EOX)
         {
             int length = read_variable_length(dataStart);
+            event->m->data.assign(1, (uint8_t) type);
             read_bytes(event->m->data, dataStart, length);
             return event;
         }
@@ -161,7 +164,8 @@ TrackEvent * parseEvent(int tick, int track, uint8_t const *& dataStart, Message
         {
             // Reuse lastEventTypeByte as the event type.
             // eventTypeByte is actually the first parameter
-            event->m->data[0] = (uint8_t) type;
+            event->m->data[0] = (uint8_t) lastEventTypeByte;
+            event->m->data[1] = (uint8_t) type;
             type = lastEventTypeByte;
         }
         else 
@@ -188,8 +192,10 @@ TrackEvent * parseEvent(int tick, int track, uint8_t const *& dataStart, Message
                 event->m->data[2] = uint8_t(*dataStart++);
                 return event;
             case MessageType::PROGRAM_CHANGE:
+                event->m->data.resize(2);
                 return event;
             case MessageType::AFTERTOUCH:
+                event->m->data.resize(2);
                 return event;
             case MessageType::PITCH_BEND: 
                 event->m->data[2] = uint8_t(*dataStart++);
@@ -258,7 +264,7 @@ void MidiFileReader::parseInternal(const std::vector<uint8_t> & buffer)
 
         MessageType runningEvent = MessageType::INVALID;
 
-        int tickCount = 0;
+        MidiTick tickCount = 0;
 
         while (dataPtr < dataEnd) 
         {
@@ -289,14 +295,14 @@ void MidiFileReader::parseInternal(const std::vector<uint8_t> & buffer)
 }
 
 // In ticks
-double MidiFileReader::getEndTime()
+MidiTick MidiFileReader::getEndTime()
 {
-    double totalLength = 0;
+    MidiTick totalLength = 0;
     for (const auto t : tracks)
     {
-        double localLength = 0;
+        MidiTick localLength = 0;
         for (const auto e : t)
-            localLength += e->tick;
+            localLength = useAbsoluteTicks ? e->tick : localLength + e->tick;
 
         if (localLength > totalLength)
             totalLength = localLength;
@@ -304,6 +310,30 @@ double MidiFileReader::getEndTime()
     return totalLength;
 }
 
+TempoMap MidiFileReader::getTempoMap() const
+{
+    std::vector<std::pair<MidiTick, uint32_t>> changes;
+    for (const auto & t : tracks)
+    {
+        MidiTick tick = 0;
+        for (const auto & e : t)
+        {
+            tick = useAbsoluteTicks ? e->tick : tick + e->tick;
+            const MidiMessage & msg = *e->m;
+            if (msg.getMetaEventSubtype() == MetaEventType::TEMPO_CHANGE && msg.messageSize() >= 6)
+                changes.push_back({tick, (uint32_t(msg[3]) << 16) | (uint32_t(msg[4]) << 8) | uint32_t(msg[5])});
+        }
+    }
+
+    // Tempo usually lives on the first track, but format 1 files may put it anywhere
+    std::stable_sort(changes.begin(), changes.end(), [](const std::pair<MidiTick, uint32_t> & a, const std::pair<MidiTick, uint32_t> & b) { return a.first < b.first; });
+
+    TempoMap map(MidiTick(ticksPerBeat), startingTempo);
+    for (const auto & c : changes)
+        if (c.second > 0) map.addTempoChange(c.first, c.second);
+    return map;
+}
+
 void MidiFileReader::parse(const std::vector<uint8_t> & buffer)
 {
     tracks.clear();
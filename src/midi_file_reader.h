@@ -94,7 +94,10 @@ public:
         
     void parse(const std::vector<uint8_t> & buffer);
 
-    double getEndTime();
+    MidiTick getEndTime();
+
+    // Tempo changes from every track, starting from startingTempo
+    TempoMap getTempoMap() const;
         
     float ticksPerBeat; // precision (number of ticks distinguishable per second)
     float startingTempo;
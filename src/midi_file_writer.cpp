@@ -118,7 +118,7 @@ void MidiFileWriter::addTrack()
     tracks.emplace_back(MidiTrack());
 }
 
-void MidiFileWriter::addEvent(int tick, int track, std::shared_ptr<MidiMessage> m)
+void MidiFileWriter::addEvent(MidiTick tick, int track, std::shared_ptr<MidiMessage> m)
 {
     if (track > tracks.size()) 
         throw std::out_of_range("track idx exceeds availble tracks");
@@ -155,7 +155,7 @@ void MidiFileWriter::write(std::ostream & out)
             // automatically after all track data has been written).
             if (msg->getMetaEventSubtype() == MetaEventType::END_OF_TRACK) continue;
 
-            util::write_variable_length(event->tick, trackRawData);
+            util::write_variable_length(uint32_t(event->tick), trackRawData);
             
             if ((msg->getMessageType() == MessageType::SYSTEM_EXCLUSIVE) || (event->m->getMessageType() == MessageType::EOX))
             {
@@ -32,6 +32,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "midi_message.h"
 #include "midi_event.h"
 #include <stdint.h>
+#include <ostream>
+
+// Big-endian and variable-length encoders shared with MidiRecorder
+namespace util
+{
+    std::ostream & write_uint16_be(std::ostream & out, uint16_t value);
+    std::ostream & write_uint32_be(std::ostream & out, uint32_t value);
+    void write_variable_length(uint32_t aValue, std::vector<uint8_t> & outdata);
+}
 
 namespace mm
 {
@@ -49,7 +58,7 @@ public:
     size_t getNumTracks() { return tracks.size(); }
     int getTicksPerQuarterNote() { return ticksPerQuarterNote; }
 
-    void addEvent(int tick, int track, std::shared_ptr<MidiMessage> m);
+    void addEvent(MidiTick tick, int track, std::shared_ptr<MidiMessage> m);
     void addEvent(int track, std::shared_ptr<TrackEvent> m);
     
     void setTicksPerQuarterNote(int tpqn) { ticksPerQuarterNote = tpqn; }
@@ -0,0 +1,131 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "midi_filter.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace mm;
+
+MidiFilter::MidiFilter(const std::vector<MidiFilterRule> & rules) : table(256 * 128, uint8_t(NoRule)), dropped(0)
+{
+    if (rules.size() >= NoRule) throw std::invalid_argument("a filter holds at most 255 rules");
+
+    for (const auto & r : rules)
+    {
+        Action a;
+        a.passes = r.passes;
+        a.remapChannel = (r.remapChannel >= 1 && r.remapChannel <= 16) ? r.remapChannel - 1 : -1;
+        a.semitones = r.semitones;
+        a.output = r.output;
+        a.queue = r.queue;
+        actions.push_back(a);
+    }
+
+    // Resolve the first matching rule for every status / data byte pair up front
+    for (int status = 0x80; status < 0x100; ++status)
+    {
+        const bool channelMessage = status < 0xF0;
+        const uint8_t type = channelMessage ? uint8_t(status & 0xF0) : uint8_t(status);
+        const int channel = (status & 0x0F) + 1;
+
+        for (int data = 0; data < 128; ++data)
+        {
+            for (size_t i = 0; i < rules.size(); ++i)
+            {
+                const auto & r = rules[i];
+                if (!r.types.empty() && std::find(r.types.begin(), r.types.end(), type) == r.types.end()) continue;
+                if (channelMessage && (channel < r.channelLow || channel > r.channelHigh)) continue;
+                if (data < r.dataLow || data > r.dataHigh) continue;
+
+                table[status * 128 + data] = uint8_t(i);
+                break;
+            }
+        }
+    }
+}
+
+bool MidiFilter::process(const MidiMessageView & in, MidiMessageView & out, uint8_t (&scratch)[3]) const
+{
+    out = in;
+    if (in.size == 0) return true;
+
+    const uint8_t status = in.data[0];
+    const uint8_t data = (in.size > 1) ? (in.data[1] & 0x7F) : 0;
+    const uint8_t rule = table[status * 128 + data];
+    if (rule == NoRule) return true;
+
+    const Action & a = actions[rule];
+
+    if ((a.remapChannel >= 0 || a.semitones != 0) && status < 0xF0 && in.size <= 3)
+    {
+        std::memcpy(scratch, in.data, in.size);
+
+        if (a.remapChannel >= 0) 
+            scratch[0] = uint8_t((status & 0xF0) | a.remapChannel);
+
+        const uint8_t type = status & 0xF0;
+        if (a.semitones != 0 && in.size > 1 && (type == 0x80 || type == 0x90 || type == 0xA0))
+        {
+            const int note = data + a.semitones;
+            if (note < 0 || note > 127) return false;
+            scratch[1] = uint8_t(note);
+        }
+
+        out = MidiMessageView(scratch, in.size, in.timestamp, in.delta);
+    }
+
+    if (a.output)
+    {
+        try
+        {
+            if (!a.output->send(out.data, out.size)) ++dropped;
+        }
+        catch (const std::exception &)
+        {
+            ++dropped; // port closed underneath us; nothing can be thrown into the driver thread
+        }
+    }
+
+    if (a.queue)
+    {
+        if (out.size > QueuedMidiMessage::Capacity)
+        {
+            ++dropped;
+        }
+        else
+        {
+            QueuedMidiMessage q;
+            q.timestamp = out.timestamp;
+            q.delta = out.delta;
+            q.size = uint8_t(out.size);
+            std::memcpy(q.data, out.data, out.size);
+            if (!a.queue->push(q)) ++dropped;
+        }
+    }
+
+    return a.passes;
+}
@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_FILTER_H
+#define MODERNMIDI_FILTER_H
+
+#include "modernmidi.h"
+#include "midi_message.h"
+#include "midi_output.h"
+#include "spsc_ring.h"
+
+#include <vector>
+#include <atomic>
+
+namespace mm
+{
+
+// One declarative rule: which messages it matches and what happens to them. Criteria left
+// unset match everything. Matching messages reach the input's callbacks unless the rule
+// forwards, queues or drops them; call pass() after forwardTo()/queueTo() to do both.
+// A queue has a single producer, so it must not be shared between inputs; an output
+// serializes its own sends and may be shared freely.
+class MidiFilterRule
+{
+    friend class MidiFilter;
+
+    std::vector<uint8_t> types;                     // MessageType values
+    uint8_t channelLow = 1, channelHigh = 16;     // 1-16, as returned by getChannel()
+    uint8_t dataLow = 0, dataHigh = 127;            // first data byte: note, controller or program
+
+    bool passes = true;
+    int remapChannel = -1;
+    int semitones = 0;
+    MidiOutput * output = nullptr;
+    SpscRing<QueuedMidiMessage> * queue = nullptr;
+
+public:
+
+    MidiFilterRule & type(MessageType t) { types.push_back(uint8_t(t)); return *this; }
+    MidiFilterRule & channels(uint8_t low, uint8_t high) { channelLow = low; channelHigh = high; return *this; }
+    MidiFilterRule & channel(uint8_t c) { return channels(c, c); }
+    MidiFilterRule & range(uint8_t low, uint8_t high) { dataLow = low; dataHigh = high; return *this; }
+
+    // Rewrites applied before the message is delivered, forwarded or queued. Transposing
+    // only affects note messages; notes pushed outside 0-127 are dropped.
+    MidiFilterRule & toChannel(uint8_t c) { remapChannel = c; return *this; }
+    MidiFilterRule & transpose(int s) { semitones = s; return *this; }
+
+    MidiFilterRule & drop() { passes = false; output = nullptr; queue = nullptr; return *this; }
+    MidiFilterRule & pass() { passes = true; return *this; }
+    MidiFilterRule & forwardTo(MidiOutput & out) { output = &out; passes = false; return *this; }
+    MidiFilterRule & queueTo(SpscRing<QueuedMidiMessage> & q) { queue = &q; passes = false; return *this; }
+};
+
+// A rule set compiled into a table indexed by status byte and first data byte, so each
+// message costs one lookup however many rules there are. The first matching rule wins and
+// unmatched messages pass unchanged. Immutable once built; install it with
+// MidiInput::setFilter() to run it on the input thread before any callback sees the message.
+class MidiFilter
+{
+    struct Action
+    {
+        bool passes;
+        int remapChannel;
+        int semitones;
+        MidiOutput * output;
+        SpscRing<QueuedMidiMessage> * queue;
+    };
+
+    static const uint8_t NoRule = 0xFF;
+
+    std::vector<Action> actions;
+    std::vector<uint8_t> table; // 256 status bytes x 128 data values -> action index
+
+    mutable std::atomic<uint64_t> dropped;
+
+public:
+
+    // Up to 255 rules
+    MidiFilter(const std::vector<MidiFilterRule> & rules);
+
+    // Runs the rules over `in`. Returns true if the message should go on to the callbacks,
+    // in which case `out` holds it, rewritten into `scratch` if a rule changed it.
+    bool process(const MidiMessageView & in, MidiMessageView & out, uint8_t (&scratch)[3]) const;
+
+    // Messages a rule tried to forward or queue but couldn't: a full queue, an output
+    // error, or a sysex message sent to a queue
+    uint64_t droppedMessages() const { return dropped; }
+};
+
+} // mm
+
+#endif
@@ -24,32 +24,144 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "midi_input.h"
+#include "midi_filter.h"
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
 
 using namespace mm;
 
 // Static
 void MidiInput::_callback(double delta, std::vector<uint8_t> * message, void * userData) 
 {
+    // Stamp before anything else so configuration work doesn't skew the timestamp
+    const MidiNanos arrival = MonotonicNanos();
+
     auto myInput = static_cast<MidiInput*>(userData);
-    myInput->handleMessage(delta * 1000, message); // convert s to ms
+
+    if (myInput->realtimeConfigPending.exchange(false))
+        ReportRealtimeConfigErrors(ApplyRealtimeConfig(myInput->realtimeConfig), "MidiInput");
+
+    myInput->handleMessage(arrival, SecondsToNanos(delta), message); // RtMidi reports seconds since the previous message
 }
 
-MidiInput::MidiInput(const std::string & name)
+MidiInput::MidiInput(const std::string & name) : realtimeConfigPending(false), filter(nullptr), callbackEpoch(0), pullOverflows(0), pullOversized(0), coalescerRunning(false), sysexAborted(0)
 {
+    coalescerBusy.clear();
+    deliverBusy.clear();
     inputDevice.reset(new RtMidiIn(RtMidi::UNSPECIFIED, name));
 }
 
 MidiInput::~MidiInput() 
 {
     closePort();
+    setCoalescing(0);
+}
+
+void MidiInput::handleMessage(MidiNanos arrival, MidiNanos delta, std::vector<uint8_t> * message)
+{
+    // Clock and other realtime messages are a single byte and sysex can be any length,
+    // so the view covers whatever arrived
+    const MidiMessageView view(message->data(), message->size(), arrival, delta);
+
+    if (sysexPool && view.size && reassemble(view)) return;
+
+    dispatch(view);
+}
+
+// Returns true if the chunk was taken into the pooled sysex buffer
+bool MidiInput::reassemble(const MidiMessageView & chunk)
+{
+    const uint8_t status = chunk.data[0];
+    const bool ends = (chunk.data[chunk.size - 1] == 0xF7);
+
+    if (sysexAssembly)
+    {
+        // Realtime bytes may be interleaved with a dump and are delivered as usual
+        if (status >= 0xF8) return false;
+
+        if (status < 0x80 || status == 0xF7)
+        {
+            sysexAssembly.append(chunk.data, chunk.size);
+            if (ends) completeSysex();
+            return true;
+        }
+
+        // Any other status before the F7 means the dump was cut off
+        sysexAborted.fetch_add(1, std::memory_order_relaxed);
+        sysexAssembly.reset();
+    }
+
+    if (status != 0xF0) return false;
+
+    // Complete in one piece and nobody wants a handle: the driver's buffer will do
+    if (ends && !sysexCallback) return false;
+
+    sysexAssembly = sysexPool->acquire(chunk.size);
+    sysexAssembly.timestamp = chunk.timestamp;
+    sysexDelta = chunk.delta;
+    sysexAssembly.append(chunk.data, chunk.size);
+    if (ends) completeSysex();
+    return true;
+}
+
+void MidiInput::completeSysex()
+{
+    SysexHandle complete(std::move(sysexAssembly));
+    const MidiMessageView view(complete.data(), complete.size(), complete.timestamp, sysexDelta);
+
+    if (dispatch(view) && sysexCallback)
+        sysexCallback(std::move(complete));
 }
 
-void MidiInput::handleMessage(double delta, std::vector<uint8_t> * message)
+bool MidiInput::dispatch(const MidiMessageView & message)
 {
-    MidiMessage incomingMsg (message->at(0),message->at(1), message->at(2));
+    MidiMessageView view = message;
+
+    uint8_t rewritten[3];
+    callbackEpoch.fetch_add(1);
+    const MidiFilter * f = filter.load();
+    const bool passed = !f || f->process(message, view, rewritten);
+    callbackEpoch.fetch_add(1);
+    if (!passed) return false;
+
+    if (coalescer)
+    {
+        while (coalescerBusy.test_and_set(std::memory_order_acquire)) {}
+        coalescer->process(view, [this](const MidiMessageView & v) { deliverCoalesced(v); });
+        coalescerBusy.clear(std::memory_order_release);
+    }
+    else deliver(view);
+
+    return true;
+}
+
+void MidiInput::deliver(const MidiMessageView & view)
+{
+    if (pullQueue)
+    {
+        if (view.size > QueuedMidiMessage::Capacity)
+        {
+            pullOversized.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            QueuedMidiMessage q;
+            q.timestamp = view.timestamp;
+            q.delta = view.delta;
+            q.size = uint8_t(view.size);
+            std::memcpy(q.data, view.data, view.size);
+            if (!pullQueue->push(q)) pullOverflows.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (rawMessageCallback)
+        rawMessageCallback(view);
 
     if (messageCallback)
-        messageCallback(incomingMsg);
+        messageCallback(view.toMessage());
 }
 
 bool MidiInput::openPort(int32_t portNumber) 
@@ -117,10 +229,181 @@ void MidiInput::closePort()
 {
     inputDevice->closePort();
     if (attached) inputDevice->cancelCallback();
+    sysexAssembly.reset(); // a dump cut off by closing is discarded
     info = {-1, false, ""};
     attached = false;
 }
 
+void MidiInput::setRealtimeConfig(const RealtimeThreadConfig & config)
+{
+    if (attached) throw std::runtime_error("the realtime configuration can only be changed while the port is closed");
+    realtimeConfig = config;
+    realtimeConfigPending = true;
+}
+
+void MidiInput::setFilter(std::unique_ptr<MidiFilter> newFilter)
+{
+    const MidiFilter * previous = filter.exchange(newFilter.get());
+
+    // If the callback is inside its filter section it may still be using the previous filter
+    const uint64_t epoch = callbackEpoch.load();
+    if (previous && (epoch & 1))
+    {
+        while (callbackEpoch.load() == epoch) std::this_thread::yield();
+    }
+
+    ownedFilter.reset(newFilter.release());
+}
+
+void MidiInput::setCoalescing(MidiNanos window)
+{
+    if (attached) throw std::runtime_error("coalescing can only be changed while the port is closed");
+
+    if (coalescerThread.joinable())
+    {
+        coalescerRunning = false;
+        coalescerThread.join();
+    }
+
+    coalescer.reset(window > 0 ? new ControllerCoalescer(window) : nullptr);
+    if (!coalescer) return;
+
+    handoff.reset(new SpscRing<QueuedMidiMessage>(256));
+    flushed.clear();
+    flushed.reserve(ControllerCoalescer::SlotCount);
+
+    coalescerRunning = true;
+    coalescerThread = std::thread(&MidiInput::coalescerMain, this);
+}
+
+uint64_t MidiInput::getCoalescedCount()
+{
+    if (!coalescer) return 0;
+    while (coalescerBusy.test_and_set(std::memory_order_acquire)) {}
+    const uint64_t n = coalescer->getCoalescedCount();
+    coalescerBusy.clear(std::memory_order_release);
+    return n;
+}
+
+// Runs on the input thread with coalescerBusy held
+void MidiInput::deliverCoalesced(const MidiMessageView & view)
+{
+    if (!deliverBusy.test_and_set(std::memory_order_acquire))
+    {
+        deliverHandoff(); // anything left while the flush thread owned delivery comes first
+        deliver(view);
+        deliverBusy.clear(std::memory_order_release);
+        return;
+    }
+
+    // The flush thread is running callbacks. It drains the handoff ring before letting go,
+    // so messages wait there in order. The input thread never waits for user code on another
+    // thread: sysex, which doesn't fit, and messages arriving to a full ring are dropped
+    // and counted as overflows.
+    QueuedMidiMessage q;
+    if (view.size <= QueuedMidiMessage::Capacity)
+    {
+        q.timestamp = view.timestamp;
+        q.delta = view.delta;
+        q.size = uint8_t(view.size);
+        std::memcpy(q.data, view.data, view.size);
+        if (handoff->push(q)) return;
+    }
+
+    pullOverflows.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Called by whichever thread owns delivery
+void MidiInput::deliverHandoff()
+{
+    QueuedMidiMessage q;
+    while (handoff->pop(q)) deliver(q.view());
+}
+
+// Delivers the tail of a burst when no further message arrives to push it out
+void MidiInput::coalescerMain()
+{
+    const MidiNanos window = coalescer->getWindow();
+    const auto period = std::chrono::nanoseconds(std::max<MidiNanos>(window / 2, 1000000));
+
+    while (coalescerRunning)
+    {
+        std::this_thread::sleep_for(period);
+
+        while (coalescerBusy.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+
+        coalescer->flushDue(MonotonicNanos(), [this](const MidiMessageView & v)
+        {
+            QueuedMidiMessage q;
+            q.timestamp = v.timestamp;
+            q.delta = v.delta;
+            q.size = uint8_t(v.size);
+            std::memcpy(q.data, v.data, v.size); // controller messages are at most 3 bytes
+            flushed.push_back(q);
+        });
+
+        // The input thread only pushes to the handoff ring inside coalescerBusy, so a message
+        // it left just as the previous cycle gave up delivery is seen here on the next one
+        if (flushed.empty() && handoff->empty())
+        {
+            coalescerBusy.clear(std::memory_order_release);
+            continue;
+        }
+
+        // Delivery is only taken by the input thread inside coalescerBusy, so this doesn't wait,
+        // and taking it before letting go keeps the flushed values ahead of later input
+        while (deliverBusy.test_and_set(std::memory_order_acquire)) {}
+        coalescerBusy.clear(std::memory_order_release);
+
+        deliverHandoff();
+        for (const auto & q : flushed) deliver(q.view());
+        flushed.clear();
+
+        // Hand delivery back, picking up anything the input thread left meanwhile
+        for (;;)
+        {
+            deliverHandoff();
+            deliverBusy.clear(std::memory_order_release);
+            if (handoff->empty() || deliverBusy.test_and_set(std::memory_order_acquire)) break;
+        }
+    }
+}
+
+void MidiInput::setSysexPool(std::shared_ptr<SysexPool> pool)
+{
+    if (attached) throw std::runtime_error("the sysex pool can only be changed while the port is closed");
+    sysexAssembly.reset();
+    sysexPool = pool;
+}
+
+void MidiInput::setPullMode(size_t capacity)
+{
+    if (attached) throw std::runtime_error("pull mode can only be changed while the port is closed");
+    pullQueue.reset(capacity ? new SpscRing<QueuedMidiMessage>(capacity) : nullptr);
+    resetPullCounters();
+}
+
+size_t MidiInput::drain(QueuedMidiMessage * events, size_t maxEvents)
+{
+    if (!pullQueue) return 0;
+    size_t n = 0;
+    while (n < maxEvents && pullQueue->pop(events[n])) ++n;
+    return n;
+}
+
+size_t MidiInput::drain(std::vector<QueuedMidiMessage> & events)
+{
+    if (!pullQueue) return 0;
+    size_t n = 0;
+    QueuedMidiMessage q;
+    while (pullQueue->pop(q))
+    {
+        events.push_back(q);
+        ++n;
+    }
+    return n;
+}
+
 void MidiInput::ignoreTypes(bool midiSysex, bool midiTiming, bool midiSense) 
 {
     inputDevice->ignoreTypes(midiSysex, midiTiming, midiSense);
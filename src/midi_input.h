@@ -30,17 +30,66 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "modernmidi.h"
 #include "midi_message.h"
+#include "realtime_thread.h"
+#include "spsc_ring.h"
+#include "controller_coalescer.h"
+#include "sysex_pool.h"
 #include <functional>
+#include <atomic>
+#include <thread>
 
 namespace mm
 {
 
+class MidiFilter;
+
 class MidiInput
 {
     std::unique_ptr<RtMidiIn> inputDevice;
     static void _callback(double delta, std::vector<uint8_t> * message, void * userData);
-    void handleMessage(double delta, std::vector<uint8_t> * message);
+    void handleMessage(MidiNanos arrival, MidiNanos delta, std::vector<uint8_t> * message);
     bool attached = false;
+
+    RealtimeThreadConfig realtimeConfig;
+    std::atomic<bool> realtimeConfigPending;
+
+    // The callback reads `filter` with the epoch odd; setFilter() waits for the epoch to
+    // move on before freeing the filter it replaced
+    std::atomic<const MidiFilter *> filter;
+    std::unique_ptr<const MidiFilter> ownedFilter;
+    std::atomic<uint64_t> callbackEpoch;
+
+    std::unique_ptr<SpscRing<QueuedMidiMessage>> pullQueue;
+    std::atomic<uint64_t> pullOverflows;
+    std::atomic<uint64_t> pullOversized;
+
+    // The coalescer's state is shared by the input thread and the flush thread under
+    // coalescerBusy, which is only ever held for bookkeeping. Delivery is owned by one thread
+    // at a time through deliverBusy; while the flush thread runs callbacks, the input thread
+    // leaves short messages in `handoff` for it instead of waiting.
+    std::unique_ptr<ControllerCoalescer> coalescer;
+    std::atomic_flag coalescerBusy;
+    std::atomic_flag deliverBusy;
+    std::unique_ptr<SpscRing<QueuedMidiMessage>> handoff;
+    std::vector<QueuedMidiMessage> flushed; // flush thread only, reserved up front
+    std::thread coalescerThread;
+    std::atomic<bool> coalescerRunning;
+
+    void deliverCoalesced(const MidiMessageView & view);
+    void deliverHandoff();
+
+    // Sysex split across driver callbacks (WinMM hands it over in 1 KB pieces) is collected
+    // here; the pool is declared first so the handle is returned before the pool goes
+    std::shared_ptr<SysexPool> sysexPool;
+    SysexHandle sysexAssembly;
+    MidiNanos sysexDelta = 0;
+    std::atomic<uint64_t> sysexAborted;
+
+    bool reassemble(const MidiMessageView & chunk);
+    void completeSysex();
+    bool dispatch(const MidiMessageView & message);
+    void deliver(const MidiMessageView & view);
+    void coalescerMain();
 public:
 
     MidiInput(const std::string & name);
@@ -50,13 +99,76 @@ public:
     bool openPort(std::string deviceName);
     bool openVirtualPort(std::string portName);
     void closePort();
+    bool isOpen() const { return attached; }
     
     void ignoreTypes(bool midiSysex, bool midiTiming, bool midiSense);
     RtMidiIn * getInputDevice() { return inputDevice.get(); }
 
+    // The input thread belongs to the RtMidi backend, so the configuration is applied
+    // from inside the first incoming callback. Failures are reported on std::cerr. Set it
+    // before opening the port; the input thread reads it without synchronization.
+    void setRealtimeConfig(const RealtimeThreadConfig & config);
+
+    // Runs the filter on the input thread before any callback sees a message. May be
+    // replaced, or cleared with nullptr, while the port is open.
+    void setFilter(std::unique_ptr<MidiFilter> newFilter);
+
     mm::MidiDeviceInfo info;
 
-    std::function<void (const mm::MidiMessage msg)> messageCallback;
+    // Messages are stamped with MonotonicNanos() on arrival, so they line up with anything
+    // played by MidiSequencePlayer / MidiSequenceScheduler on the default clock, and carry
+    // the driver-reported delta since the previous message.
+
+    // Zero-copy delivery: a view straight over the driver's buffer, for messages of any
+    // length. Nothing is allocated on the input thread unless the callback does so.
+    std::function<void (const mm::MidiMessageView & msg)> rawMessageCallback;
+
+    // Convenience delivery of an owned copy; costs one allocation per message
+    std::function<void (const mm::MidiMessage & msg)> messageCallback;
+
+    // Reassembles sysex that arrives in several driver callbacks into buffers from the pool,
+    // so bulk dumps arrive whole without allocation; realtime bytes interleaved with a dump
+    // are still delivered as they come. Complete sysex goes through the filter and the usual
+    // callbacks as a view of the pooled buffer, then to sysexCallback if set. Set while the
+    // port is closed; the pool may be shared between inputs.
+    void setSysexPool(std::shared_ptr<SysexPool> pool);
+
+    // Receives ownership of each complete sysex message; the buffer returns to the pool
+    // when the handle is dropped, on whichever thread that happens
+    std::function<void (mm::SysexHandle handle)> sysexCallback;
+
+    // Dumps abandoned because another message started before their F7
+    uint64_t getSysexAbortedCount() const { return sysexAborted; }
+
+    // Rate-caps controller, pitch bend and pressure floods to one message per (channel,
+    // controller) per window, keeping the latest value; notes are never coalesced or
+    // reordered (see ControllerCoalescer). A small thread delivers the last held value of
+    // a burst once its window ends, so callbacks may also run on that thread, never
+    // concurrently with the input thread. Messages arriving while those callbacks run are
+    // queued for it to deliver next (up to 256, see getOverflowCount). Change it while the
+    // port is closed; 0 disables.
+    void setCoalescing(MidiNanos window);
+    uint64_t getCoalescedCount();
+
+    // Pull mode: messages that pass the filter are also copied into a preallocated ring of
+    // `capacity` entries, for a game or audio loop to collect once per frame with drain().
+    // Sysex doesn't fit a ring entry and is counted as oversized instead. Enable or disable
+    // (capacity 0) while the port is closed; drain() must be called from one thread.
+    void setPullMode(size_t capacity);
+    bool isPullMode() const { return pullQueue != nullptr; }
+
+    // Copies up to `maxEvents` pending messages, oldest first, and returns how many
+    size_t drain(QueuedMidiMessage * events, size_t maxEvents);
+
+    // Appends every pending message
+    size_t drain(std::vector<QueuedMidiMessage> & events);
+
+    // Messages lost because the ring was full, or because they were too long for an entry.
+    // Overflows also count messages dropped while callbacks on the coalescing flush thread
+    // held up delivery for longer than the input thread may wait.
+    uint64_t getOverflowCount() const { return pullOverflows; }
+    uint64_t getOversizedCount() const { return pullOversized; }
+    void resetPullCounters() { pullOverflows = 0; pullOversized = 0; }
 };
 
 }
@@ -0,0 +1,110 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "midi_input_aggregator.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace mm;
+
+MidiInputAggregator::MidiInputAggregator(MidiNanos reorderWindow, size_t capacity) : capacity(capacity), reorderWindow(reorderWindow)
+{
+    if (capacity == 0) throw std::invalid_argument("reorder buffer capacity must be positive");
+    heap.reserve(capacity);
+}
+
+size_t MidiInputAggregator::addInput(MidiInput & input, size_t ringCapacity)
+{
+    input.setPullMode(ringCapacity);
+    inputs.push_back(&input);
+    return inputs.size() - 1;
+}
+
+// Pulls from the per-port rings until the reorder buffer is full; anything left waits in
+// the rings for the next poll
+void MidiInputAggregator::gather()
+{
+    for (size_t port = 0; port < inputs.size(); ++port)
+    {
+        Pending p;
+        p.event.port = port;
+        while (heap.size() < capacity && inputs[port]->drain(&p.event.msg, 1))
+        {
+            if (p.event.msg.timestamp < released) ++late;
+            p.sequence = sequence++;
+            heap.push_back(p);
+            std::push_heap(heap.begin(), heap.end(), Later());
+        }
+    }
+}
+
+size_t MidiInputAggregator::release(AggregatedMidiMessage * events, size_t maxEvents, MidiNanos horizon)
+{
+    size_t n = 0;
+    while (n < maxEvents && !heap.empty())
+    {
+        // A full buffer gives up its oldest entries rather than stalling the rings
+        if (heap.front().event.msg.timestamp > horizon && heap.size() < capacity) break;
+
+        std::pop_heap(heap.begin(), heap.end(), Later());
+        events[n++] = heap.back().event;
+        released = std::max(released, heap.back().event.msg.timestamp);
+        heap.pop_back();
+    }
+    return n;
+}
+
+size_t MidiInputAggregator::poll(AggregatedMidiMessage * events, size_t maxEvents)
+{
+    return poll(events, maxEvents, MonotonicNanos());
+}
+
+size_t MidiInputAggregator::poll(AggregatedMidiMessage * events, size_t maxEvents, MidiNanos now)
+{
+    size_t n = 0;
+    for (;;)
+    {
+        gather();
+        const size_t r = release(events + n, maxEvents - n, now - reorderWindow);
+        n += r;
+
+        // Releasing made room, so the rings may have more for this window
+        if (r == 0 || n == maxEvents) break;
+    }
+    return n;
+}
+
+size_t MidiInputAggregator::flush(AggregatedMidiMessage * events, size_t maxEvents)
+{
+    return poll(events, maxEvents, std::numeric_limits<MidiNanos>::max());
+}
+
+uint64_t MidiInputAggregator::getOverflowCount() const
+{
+    uint64_t total = 0;
+    for (auto input : inputs) total += input->getOverflowCount();
+    return total;
+}
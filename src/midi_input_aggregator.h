@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_INPUT_AGGREGATOR_H
+#define MODERNMIDI_INPUT_AGGREGATOR_H
+
+#include "modernmidi.h"
+#include "midi_input.h"
+
+#include <vector>
+
+namespace mm
+{
+
+struct AggregatedMidiMessage
+{
+    QueuedMidiMessage msg;
+    size_t port = 0; // index returned by MidiInputAggregator::addInput
+};
+
+// Merges many MidiInputs into one stream ordered by arrival timestamp. Each input runs in
+// pull mode, so its RtMidi thread only writes to its own SPSC ring; a single consumer
+// thread calls poll(), which moves pending messages into a bounded reorder buffer and
+// releases those older than the reorder window in timestamp order. Equal timestamps are
+// released by port index, then arrival.
+//
+// A message that reaches the buffer after a later one was already released is delivered
+// straight away and counted as late; widen the window if that happens. When the buffer is
+// full the oldest messages are released early. Sysex is not carried (see setPullMode).
+class MidiInputAggregator
+{
+    struct Pending
+    {
+        AggregatedMidiMessage event;
+        uint64_t sequence;
+    };
+
+    struct Later
+    {
+        bool operator()(const Pending & a, const Pending & b) const
+        {
+            if (a.event.msg.timestamp != b.event.msg.timestamp) return a.event.msg.timestamp > b.event.msg.timestamp;
+            if (a.event.port != b.event.port) return a.event.port > b.event.port;
+            return a.sequence > b.sequence;
+        }
+    };
+
+    std::vector<MidiInput *> inputs;
+    std::vector<Pending> heap; // min-heap on (timestamp, port, sequence), reserved up front
+    size_t capacity;
+    MidiNanos reorderWindow;
+    uint64_t sequence = 0;
+    MidiNanos released = 0;
+    uint64_t late = 0;
+
+    void gather();
+    size_t release(AggregatedMidiMessage * events, size_t maxEvents, MidiNanos horizon);
+
+public:
+
+    // reorderWindow bounds how long a message is held back waiting for earlier ones from
+    // other ports; capacity bounds the reorder buffer
+    MidiInputAggregator(MidiNanos reorderWindow = 2000000, size_t capacity = 1024);
+
+    // Puts the input in pull mode with a ring of ringCapacity entries, so it must be added
+    // while its port is closed. Returns the port index used to tag its messages.
+    size_t addInput(MidiInput & input, size_t ringCapacity = 1024);
+
+    void setReorderWindow(MidiNanos window) { reorderWindow = window; }
+    MidiNanos getReorderWindow() const { return reorderWindow; }
+
+    // Releases up to maxEvents messages stamped at or before now - reorderWindow, using
+    // MonotonicNanos() or an explicit time on the same timebase. Returns how many.
+    size_t poll(AggregatedMidiMessage * events, size_t maxEvents);
+    size_t poll(AggregatedMidiMessage * events, size_t maxEvents, MidiNanos now);
+
+    // Releases everything pending regardless of the window, e.g. at shutdown
+    size_t flush(AggregatedMidiMessage * events, size_t maxEvents);
+
+    // Messages delivered out of order because they arrived after the window closed on them
+    uint64_t getLateCount() const { return late; }
+
+    // Messages lost to full per-port rings, summed over all inputs
+    uint64_t getOverflowCount() const;
+};
+
+} // mm
+
+#endif
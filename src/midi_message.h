@@ -29,6 +29,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MODERNMIDI_MESSAGE_H
 
 #include "modernmidi.h"
+#include "midi_time.h"
 #include <stdint.h>
 #include <vector>
 #include <memory>
@@ -144,8 +145,8 @@ namespace mm
     struct MidiMessage
     {
         MidiMessage() { data = {0, 0, 0}; }
-        MidiMessage(const uint8_t b1, const uint8_t b2, const uint8_t b3, const double ts = 0) : timestamp(ts) { data = {b1, b2, b3}; }
-        MidiMessage(const uint8_t b1, const  uint8_t b2, const double ts = 0) : timestamp(ts) { data = {b1, b2}; }
+        MidiMessage(const uint8_t b1, const uint8_t b2, const uint8_t b3, const MidiNanos ts = 0) : timestamp(ts) { data = {b1, b2, b3}; }
+        MidiMessage(const uint8_t b1, const  uint8_t b2, const MidiNanos ts = 0) : timestamp(ts) { data = {b1, b2}; }
         MidiMessage(const std::vector<uint8_t> msg) { data = msg; };
         MidiMessage(const MidiMessage & rhs) { *this = rhs; }
         
@@ -153,6 +154,7 @@ namespace mm
         {
             data = rhs.data;
             timestamp = rhs.timestamp;
+            delta = rhs.delta;
             return *this;
         }
         
@@ -195,10 +197,78 @@ namespace mm
         
         size_t messageSize() const { return data.size(); }
         
-        double timestamp = 0;
+        // Incoming messages: MonotonicNanos() at arrival, the same timebase the sequencers
+        // play on, and the driver's own measure of the time since the previous message
+        MidiNanos timestamp = 0;
+        MidiNanos delta = 0;
 
         std::vector<unsigned char> data;
     };
+
+    //////////////////////
+    // MidiMessageView  //
+    //////////////////////
+
+    // Non-owning view of a message of any length (including 1-byte realtime messages and
+    // whole sysex dumps) living in someone else's buffer, e.g. the driver's input buffer.
+    // Only valid for the duration of the call it is passed to; use toMessage() to keep it.
+    struct MidiMessageView
+    {
+        const uint8_t * data = nullptr;
+        size_t size = 0;
+        MidiNanos timestamp = 0;
+        MidiNanos delta = 0;
+
+        MidiMessageView() {}
+        MidiMessageView(const uint8_t * data, size_t size, MidiNanos ts = 0, MidiNanos delta = 0) : data(data), size(size), timestamp(ts), delta(delta) {}
+        MidiMessageView(const MidiMessage & msg) : data(msg.data.data()), size(msg.data.size()), timestamp(msg.timestamp), delta(msg.delta) {}
+
+        uint8_t operator [] (size_t i) const { assert(i < size); return data[i]; }
+
+        size_t messageSize() const { return size; }
+
+        int getChannel() const
+        {
+            if (size && (data[0] & 0xF0) != 0xF0)
+                return (data[0] & 0xF) + 1;
+            return 0;
+        }
+
+        MessageType getMessageType() const
+        {
+            if (!size) return MessageType::INVALID;
+            if (data[0] >= uint8_t(MessageType::SYSTEM_EXCLUSIVE)) { return (MessageType) (data[0] & 0xFF); }
+            else { return (MessageType) (data[0] & 0xF0); }
+        }
+
+        bool isNoteOnOrOff() const
+        {
+            const auto status = getMessageType();
+            return (status == MessageType::NOTE_ON) || (status == MessageType::NOTE_OFF);
+        }
+
+        MidiMessage toMessage() const
+        {
+            MidiMessage m(std::vector<uint8_t>(data, data + size));
+            m.timestamp = timestamp;
+            m.delta = delta;
+            return m;
+        }
+    };
+
+    // Fixed-size copy of a channel or system common message, for queues that must not
+    // allocate. Sysex doesn't fit.
+    struct QueuedMidiMessage
+    {
+        MidiNanos timestamp = 0;
+        MidiNanos delta = 0;
+        uint8_t size = 0;
+        uint8_t data[3];
+
+        static const size_t Capacity = 3;
+
+        MidiMessageView view() const { return MidiMessageView(data, size, timestamp, delta); }
+    };
     
     ///////////////////////
     // Message Factories //
@@ -29,6 +29,7 @@ using namespace mm;
 
 MidiOutput::MidiOutput(const std::string & name) 
 {
+    scratch.reserve(3);
     outputDevice.reset(new RtMidiOut(RtMidi::UNSPECIFIED, name));
 }
 
@@ -106,13 +107,19 @@ void MidiOutput::closePort()
     attached = false;
 }
 
-bool MidiOutput::sendRaw(std::vector<unsigned char> msg)
+void MidiOutput::checkAttached() const
 {
     if (!outputDevice) throw std::runtime_error("output device not initialized");
     if (!attached) throw std::runtime_error("interface not bound to a port");
+}
+
+// Called with sendMutex held
+bool MidiOutput::sendToDriver(const std::vector<unsigned char> & msg)
+{
     try 
     {
-        outputDevice->sendMessage(&msg);
+        // RtMidi only reads through this pointer
+        outputDevice->sendMessage(const_cast<std::vector<unsigned char> *>(&msg));
     }
     catch(RtMidiError & e) 
     {
@@ -122,12 +129,77 @@ bool MidiOutput::sendRaw(std::vector<unsigned char> msg)
     return true;
 }
 
+bool MidiOutput::sendUnchecked(const std::vector<unsigned char> & msg)
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    return sendToDriver(msg);
+}
+
+bool MidiOutput::sendUnchecked(const uint8_t * data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    scratch.assign(data, data + size);
+    return sendToDriver(scratch);
+}
+
+size_t MidiOutput::sendBatch(const mm::MidiMessage * const * messages, size_t count)
+{
+    checkAttached();
+    size_t sent = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (sendUnchecked(messages[i]->data)) ++sent;
+    }
+    return sent;
+}
+
+size_t MidiOutput::sendBatch(const std::vector<mm::MidiMessage> & messages)
+{
+    checkAttached();
+    size_t sent = 0;
+    for (const auto & m : messages)
+    {
+        if (sendUnchecked(m.data)) ++sent;
+    }
+    return sent;
+}
+
+size_t MidiOutput::sendBatch(const mm::MidiMessageView * messages, size_t count)
+{
+    checkAttached();
+    size_t sent = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (sendUnchecked(messages[i].data, messages[i].size)) ++sent;
+    }
+    return sent;
+}
+
+size_t MidiOutput::sendBatch(const mm::QueuedMidiMessage * messages, size_t count)
+{
+    checkAttached();
+    size_t sent = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (sendUnchecked(messages[i].data, messages[i].size)) ++sent;
+    }
+    return sent;
+}
+
 bool MidiOutput::send(const std::vector<uint8_t> & msg)
 {
-    return sendRaw(static_cast<std::vector<unsigned char>>(msg));
+    checkAttached();
+    return sendUnchecked(msg);
 }
 
 bool MidiOutput::send(const mm::MidiMessage & msg)
 {
-    return sendRaw(static_cast<std::vector<unsigned char>>(msg.data));
-}
\ No newline at end of file
+    checkAttached();
+    return sendUnchecked(msg.data);
+}
+
+bool MidiOutput::send(const uint8_t * data, size_t size)
+{
+    checkAttached();
+    return sendUnchecked(data, size);
+}
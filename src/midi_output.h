@@ -30,6 +30,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "modernmidi.h"
 #include "midi_message.h"
+#include <mutex>
 
 namespace mm
 {
@@ -38,7 +39,17 @@ class MidiOutput
 {
     bool attached = false;
 
-    bool sendRaw(std::vector<unsigned char> msg);
+    // Every send goes through sendMutex, so filters, routers and sequencers on different
+    // threads can share an output. It is held only for the driver call (and the copy into
+    // `scratch`), never while user code runs. A blocking lock rather than a spin lock,
+    // since a driver write can take long enough that a waiting sender would burn a core.
+    std::mutex sendMutex;
+    std::vector<unsigned char> scratch; // reused by send(data, size); keeps its capacity
+
+    bool sendToDriver(const std::vector<unsigned char> & msg);
+    bool sendUnchecked(const std::vector<unsigned char> & msg);
+    bool sendUnchecked(const uint8_t * data, size_t size);
+    void checkAttached() const;
 
 public:
 
@@ -50,9 +61,24 @@ public:
     bool openVirtualPort(std::string portName);
     void closePort();
     
+    // Vectors and messages are handed to the driver in place, without copying
     bool send(const std::vector<uint8_t> & msg);
     bool send(const mm::MidiMessage & msg);
 
+    // Sends from caller-owned bytes. RtMidi only accepts a vector, so the bytes are staged
+    // in a buffer owned by the output, which stops allocating once it has grown to the
+    // largest message sent.
+    bool send(const uint8_t * data, size_t size);
+    bool send(const mm::MidiMessageView & msg) { return send(msg.data, msg.size); }
+
+    // Sends a group of messages back to back: the device is validated once and each
+    // message's bytes go to the driver without temporary vectors. Returns the number
+    // of messages that were sent successfully.
+    size_t sendBatch(const mm::MidiMessage * const * messages, size_t count);
+    size_t sendBatch(const std::vector<mm::MidiMessage> & messages);
+    size_t sendBatch(const mm::MidiMessageView * messages, size_t count);
+    size_t sendBatch(const mm::QueuedMidiMessage * messages, size_t count);
+
     RtMidiOut * getOutputDevice() { return outputDevice.get(); }
 
     mm::MidiDeviceInfo info;
@@ -0,0 +1,177 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "midi_playlist.h"
+
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+using namespace mm;
+
+std::unique_ptr<MidiSequenceSnapshot> mm::MakeSequenceSnapshot(const MidiFileReader & reader)
+{
+    std::unique_ptr<MidiSequenceSnapshot> seq(new MidiSequenceSnapshot());
+    seq->ticksPerBeat = reader.ticksPerBeat;
+    seq->beatsPerMinute = reader.getTempoMap().beatsPerMinuteAt(0);
+
+    for (size_t i = 0; i < reader.tracks.size(); ++i)
+    {
+        MidiTick tick = 0;
+        for (const auto & e : reader.tracks[i])
+        {
+            tick = reader.useAbsoluteTicks ? e->tick : tick + e->tick;
+            if (!e->m->isMetaEvent()) seq->events.push_back(MidiPlayerEvent(0, tick, e->m, int(i)));
+        }
+        seq->endTick = std::max(seq->endTick, tick);
+    }
+
+    // Stable, so simultaneous events keep their track order
+    std::stable_sort(seq->events.begin(), seq->events.end(), [](const MidiPlayerEvent & a, const MidiPlayerEvent & b) { return a.tick < b.tick; });
+
+    seq->tempoMap = TempoMap(MidiTick(seq->ticksPerBeat), seq->beatsPerMinute);
+    TempoMap::Cursor timeline(seq->tempoMap);
+    for (auto & ev : seq->events)
+        ev.timestamp = timeline.nanosAt(ev.tick);
+
+    seq->buildChaseSnapshots();
+    return seq;
+}
+
+MidiPlaylist::MidiPlaylist(MidiSequencePlayer & player, size_t preloadCount) : player(player), preloadCount(std::max(size_t(1), preloadCount)), shouldLoad(false)
+{
+
+}
+
+MidiPlaylist::~MidiPlaylist()
+{
+    stop();
+}
+
+void MidiPlaylist::add(const std::string & path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    files.push_back(path);
+    changed.notify_all();
+}
+
+size_t MidiPlaylist::pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return files.size();
+}
+
+std::unique_ptr<MidiSequenceSnapshot> MidiPlaylist::load(const std::string & path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) throw std::runtime_error("couldn't open file");
+
+    std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    MidiFileReader reader;
+    reader.useAbsoluteTicks = true;
+    reader.parse(buffer);
+
+    return MakeSequenceSnapshot(reader);
+}
+
+void MidiPlaylist::start()
+{
+    if (shouldLoad) throw std::runtime_error("playlist is already playing");
+
+    // The first file has nothing to hide behind, so it loads up front
+    std::unique_ptr<MidiSequenceSnapshot> first;
+    while (!first)
+    {
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (files.empty()) throw std::runtime_error("playlist is empty");
+            path = files.front();
+            files.pop_front();
+        }
+
+        try { first = load(path); }
+        catch (const std::exception & e) { std::cerr << "MidiPlaylist: " << path << ": " << e.what() << std::endl; }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(playerMutex);
+        player.setTempo(first->beatsPerMinute);
+        player.publish(std::move(first));
+        player.start();
+    }
+
+    shouldLoad = true;
+    loaderThread = std::thread(&MidiPlaylist::loaderMain, this);
+}
+
+void MidiPlaylist::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shouldLoad = false;
+        changed.notify_all();
+    }
+
+    if (loaderThread.joinable())
+        loaderThread.join();
+
+    std::lock_guard<std::mutex> lock(playerMutex);
+    player.stop();
+}
+
+void MidiPlaylist::loaderMain()
+{
+    std::unique_ptr<MidiSequenceSnapshot> ready;
+
+    while (shouldLoad)
+    {
+        {
+            std::lock_guard<std::mutex> lock(playerMutex);
+            player.reclaim();
+
+            // A loaded file waits here until the player's queue has room
+            if (ready && player.queuedSequences() < preloadCount)
+                player.enqueue(ready);
+        }
+
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            // Poll as well, since room in the queue appears on the sequencer thread without a notification
+            changed.wait_for(lock, std::chrono::milliseconds(20), [&] { return !shouldLoad || (!ready && !files.empty() && player.queuedSequences() < preloadCount); });
+            if (!shouldLoad) break;
+            if (ready || files.empty() || player.queuedSequences() >= preloadCount) continue;
+
+            path = files.front();
+            files.pop_front();
+        }
+
+        try { ready = load(path); }
+        catch (const std::exception & e) { std::cerr << "MidiPlaylist: " << path << ": " << e.what() << std::endl; }
+    }
+}
@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_PLAYLIST_H
+#define MODERNMIDI_PLAYLIST_H
+
+#include "modernmidi.h"
+#include "midi_file_reader.h"
+#include "sequence_player.h"
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace mm
+{
+
+// Merges every track of a parsed file into one snapshot, sorted by tick, with the file's
+// resolution and initial tempo. Meta events are dropped, including later tempo changes:
+// the player schedules by tick at one tempo per sequence, so event timestamps are
+// computed at the initial tempo to match.
+std::unique_ptr<MidiSequenceSnapshot> MakeSequenceSnapshot(const MidiFileReader & reader);
+
+// Plays .mid files back to back on a MidiSequencePlayer. A background thread reads,
+// parses and merges up to preloadCount files ahead and queues them on the player, which
+// switches from one to the next on its own timeline without a gap. Files that fail to
+// load are reported on std::cerr and skipped. If loading falls behind playback, the
+// player stops at the end of the current file. While the playlist runs it must be the
+// player's only editor; its own edits are serialized by playerMutex.
+class MidiPlaylist
+{
+    MidiSequencePlayer & player;
+    size_t preloadCount;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::mutex playerMutex; // held around every call that edits the player
+    std::deque<std::string> files;
+
+    std::thread loaderThread;
+    std::atomic<bool> shouldLoad;
+
+    void loaderMain();
+    std::unique_ptr<MidiSequenceSnapshot> load(const std::string & path);
+
+public:
+
+    MidiPlaylist(MidiSequencePlayer & player, size_t preloadCount = 2);
+    ~MidiPlaylist();
+
+    // Thread-safe; may be called while playing
+    void add(const std::string & path);
+
+    // Loads the first file on the calling thread, starts the player and the loader
+    void start();
+    void stop();
+
+    // Files added but not yet handed to the player
+    size_t pending();
+};
+
+} // mm
+
+#endif
@@ -0,0 +1,245 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "midi_recorder.h"
+#include "midi_file_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+
+using namespace mm;
+
+MidiRecorder::MidiRecorder(MidiTick ticksPerBeat, double beatsPerMinute, size_t capacity)
+    : tempoMap(ticksPerBeat, beatsPerMinute), beatsPerMinute(beatsPerMinute), capacity(capacity), recording(false), recorded(0)
+{
+    if (ticksPerBeat <= 0 || ticksPerBeat > 0x7FFF) throw std::invalid_argument("ticks per beat must be between 1 and 32767");
+    if (beatsPerMinute <= 0) throw std::invalid_argument("tempo must be positive");
+}
+
+MidiRecorder::~MidiRecorder()
+{
+    stop();
+
+    for (auto & source : sources)
+    {
+        source->recorder.store(nullptr);
+
+        // Wait for the input thread to leave a capture that may still be using the recorder
+        const uint64_t epoch = source->epoch.load();
+        if (epoch & 1)
+        {
+            while (source->epoch.load() == epoch) std::this_thread::yield();
+        }
+
+        // Replacing the callback of an open port would race the input thread calling it
+        if (!source->input->isOpen()) source->input->rawMessageCallback = source->previous;
+    }
+}
+
+void MidiRecorder::attach(MidiInput & input)
+{
+    if (recording) throw std::runtime_error("can't attach an input while recording");
+
+    std::shared_ptr<Source> source = std::make_shared<Source>(input, this, capacity);
+    sources.push_back(source);
+
+    input.rawMessageCallback = [source](const MidiMessageView & msg)
+    {
+        source->epoch.fetch_add(1);
+        if (MidiRecorder * recorder = source->recorder.load()) recorder->capture(*source, msg);
+        source->epoch.fetch_add(1);
+
+        if (source->previous) source->previous(msg);
+    };
+}
+
+// Runs on the input thread: no locks, no allocation
+void MidiRecorder::capture(Source & source, const MidiMessageView & msg)
+{
+    if (!recording.load(std::memory_order_acquire) || msg.size == 0) return;
+
+    const uint8_t status = msg.data[0];
+    if (status < 0x80 || status > 0xF0) return;
+
+    const size_t chunks = (msg.size + ChunkBytes - 1) / ChunkBytes;
+    if (source.ring.writeAvailable() < chunks)
+    {
+        source.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Chunk chunk;
+    chunk.timestamp = msg.timestamp;
+    for (size_t offset = 0; offset < msg.size; offset += ChunkBytes)
+    {
+        const size_t remaining = msg.size - offset;
+        chunk.size = uint16_t(remaining < ChunkBytes ? remaining : ChunkBytes);
+        chunk.last = (offset + chunk.size == msg.size);
+        std::memcpy(chunk.data, msg.data + offset, chunk.size);
+        source.ring.push(chunk);
+    }
+}
+
+bool MidiRecorder::start(const std::string & path)
+{
+    if (recording) throw std::runtime_error("recorder is already running");
+
+    file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "MidiRecorder: couldn't open " << path << std::endl;
+        return false;
+    }
+
+    // Anything left over from a previous take is discarded
+    Chunk stale;
+    for (auto & source : sources)
+    {
+        while (source->ring.pop(stale)) {}
+        source->partial.clear();
+    }
+
+    file << 'M'; file << 'T'; file << 'h'; file << 'd';
+    util::write_uint32_be(file, 6);
+    util::write_uint16_be(file, 0);
+    util::write_uint16_be(file, 1);
+    util::write_uint16_be(file, uint16_t(tempoMap.getTicksPerBeat()));
+
+    file << 'M'; file << 'T'; file << 'r'; file << 'k';
+    lengthPosition = file.tellp();
+    util::write_uint32_be(file, 0); // patched by stop()
+
+    const uint32_t mpqn = uint32_t(std::round(60000000.0 / beatsPerMinute));
+    encoded.clear();
+    encoded.push_back(0x00);
+    encoded.push_back(0xFF); encoded.push_back(0x51); encoded.push_back(0x03);
+    encoded.push_back(uint8_t(mpqn >> 16)); encoded.push_back(uint8_t(mpqn >> 8)); encoded.push_back(uint8_t(mpqn));
+    trackLength = 0;
+    writeEncoded();
+
+    lastTick = 0;
+    recorded = 0;
+    origin = MonotonicNanos();
+    recording.store(true, std::memory_order_release);
+    writerThread = std::thread(&MidiRecorder::writerMain, this);
+    return true;
+}
+
+void MidiRecorder::stop()
+{
+    if (!recording) return;
+
+    recording = false;
+    if (writerThread.joinable()) writerThread.join();
+
+    encoded.clear();
+    encoded.push_back(0x00);
+    encoded.push_back(0xFF); encoded.push_back(0x2F); encoded.push_back(0x00);
+    writeEncoded();
+
+    file.seekp(lengthPosition);
+    util::write_uint32_be(file, trackLength);
+    file.close();
+}
+
+uint64_t MidiRecorder::droppedMessages() const
+{
+    uint64_t total = 0;
+    for (auto & source : sources) total += source->dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+void MidiRecorder::writerMain()
+{
+    while (recording.load(std::memory_order_acquire))
+    {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    drain(); // whatever arrived before the flag was seen
+}
+
+void MidiRecorder::drain()
+{
+    Chunk chunk;
+    for (auto & source : sources)
+    {
+        while (source->ring.pop(chunk))
+        {
+            if (source->partial.empty()) source->partialTime = chunk.timestamp;
+            source->partial.insert(source->partial.end(), chunk.data, chunk.data + chunk.size);
+            if (!chunk.last) continue;
+
+            Captured c;
+            c.timestamp = source->partialTime;
+            c.bytes.swap(source->partial);
+            captured.push_back(std::move(c));
+        }
+    }
+
+    if (captured.empty()) return;
+
+    // Each input is in order already; interleave them by arrival time
+    std::stable_sort(captured.begin(), captured.end(), [](const Captured & a, const Captured & b)
+    {
+        return a.timestamp < b.timestamp;
+    });
+
+    encoded.clear();
+    for (auto & c : captured)
+    {
+        if (c.timestamp < origin) continue;
+
+        // A message that raced the previous drain on another input lands on the last written tick
+        const MidiTick tick = std::max(lastTick, tempoMap.tickAt(c.timestamp - origin));
+        util::write_variable_length(uint32_t(tick - lastTick), encoded);
+        lastTick = tick;
+
+        if (c.bytes[0] == 0xF0)
+        {
+            // Sysex is stored as F0, a variable-length count, then the rest of the bytes
+            encoded.push_back(0xF0);
+            util::write_variable_length(uint32_t(c.bytes.size() - 1), encoded);
+            encoded.insert(encoded.end(), c.bytes.begin() + 1, c.bytes.end());
+        }
+        else
+        {
+            encoded.insert(encoded.end(), c.bytes.begin(), c.bytes.end());
+        }
+        ++recorded;
+    }
+    captured.clear();
+
+    writeEncoded();
+}
+
+void MidiRecorder::writeEncoded()
+{
+    file.write((const char *) encoded.data(), encoded.size());
+    trackLength += uint32_t(encoded.size());
+    encoded.clear();
+}
@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_RECORDER_H
+#define MODERNMIDI_RECORDER_H
+
+#include "modernmidi.h"
+#include "midi_message.h"
+#include "midi_input.h"
+#include "midi_time.h"
+#include "spsc_ring.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+namespace mm
+{
+
+// Streams live input from one or more MidiInputs into a format 0 standard MIDI file.
+// The input callbacks only copy bytes into a per-input SpscRing, which is wait-free and
+// never allocates; a background thread converts arrival times to ticks against a fixed
+// tempo, encodes the events and writes them to disk as it goes, so memory stays flat on
+// long takes. The track length is patched into the header by stop().
+//
+// Channel messages and complete sysex are recorded. System common and realtime messages
+// have no place in a file and are ignored. When an input's ring is full, its messages are
+// dropped and counted rather than blocking the driver thread.
+class MidiRecorder
+{
+    static const size_t ChunkBytes = 20;
+
+    // Messages longer than ChunkBytes span consecutive chunks with the same timestamp
+    struct Chunk
+    {
+        MidiNanos timestamp;
+        uint16_t size;
+        bool last;
+        uint8_t data[ChunkBytes];
+    };
+
+    // Shared with the input's callback, which reaches the recorder through `recorder` with
+    // the epoch odd, so the callback may outlive the recorder if the port is still open
+    struct Source
+    {
+        MidiInput * input;
+        std::function<void (const MidiMessageView & msg)> previous;
+        std::atomic<MidiRecorder *> recorder;
+        std::atomic<uint64_t> epoch;
+
+        SpscRing<Chunk> ring;
+        std::atomic<uint64_t> dropped;
+
+        // Reassembly state, touched by the writer only
+        std::vector<uint8_t> partial;
+        MidiNanos partialTime = 0;
+
+        Source(MidiInput & input, MidiRecorder * recorder, size_t capacity) : input(&input), previous(input.rawMessageCallback), recorder(recorder), epoch(0), ring(capacity), dropped(0) {}
+    };
+
+    struct Captured
+    {
+        MidiNanos timestamp;
+        std::vector<uint8_t> bytes;
+    };
+
+    TempoMap tempoMap;
+    double beatsPerMinute;
+    size_t capacity;
+
+    std::vector<std::shared_ptr<Source>> sources;
+    std::atomic<bool> recording;
+    MidiNanos origin = 0;
+
+    std::thread writerThread;
+    std::ofstream file;
+    std::streampos lengthPosition;
+    uint32_t trackLength = 0;
+    MidiTick lastTick = 0;
+    std::vector<Captured> captured;
+    std::vector<uint8_t> encoded;
+    std::atomic<uint64_t> recorded;
+
+    void capture(Source & source, const MidiMessageView & msg);
+    void writerMain();
+    void drain();
+    void writeEncoded();
+
+public:
+
+    // ticksPerBeat becomes the file's division and must fit in 15 bits. capacity is the
+    // ring size per input, in 20-byte chunks.
+    MidiRecorder(MidiTick ticksPerBeat = 480, double beatsPerMinute = 120, size_t capacity = 4096);
+    ~MidiRecorder();
+
+    // Installs a capture callback on the input, chaining to any rawMessageCallback already
+    // set. Attach before the input's port is opened and while stopped. On destruction the
+    // recorder detaches from every input and puts back the previous callback on those
+    // already closed; open inputs keep a callback that only chains to the previous one.
+    void attach(MidiInput & input);
+
+    // Creates the file and starts recording; messages stamped before this call are ignored.
+    // Returns false if the file can't be opened, after reporting it on std::cerr.
+    bool start(const std::string & path);
+
+    // Writes out everything captured so far, finishes the track and closes the file
+    void stop();
+
+    bool isRecording() const { return recording; }
+
+    uint64_t recordedMessages() const { return recorded; }
+    uint64_t droppedMessages() const;
+};
+
+} // mm
+
+#endif
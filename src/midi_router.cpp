@@ -0,0 +1,167 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "midi_router.h"
+
+#include <thread>
+
+using namespace mm;
+
+MidiRouter::MidiRouter() : sendErrors(0) { }
+
+MidiRouter::~MidiRouter()
+{
+    disconnectAll();
+
+    for (auto & in : inputs)
+    {
+        in->router.store(nullptr);
+        waitForPass(*in);
+
+        // Replacing the callback of an open port would race the input thread calling it
+        if (!in->input->isOpen()) in->input->rawMessageCallback = in->previous;
+    }
+}
+
+size_t MidiRouter::addInput(MidiInput & input)
+{
+    std::shared_ptr<InputPort> port = std::make_shared<InputPort>(input, this);
+    inputs.push_back(port);
+
+    input.rawMessageCallback = [port](const MidiMessageView & msg)
+    {
+        port->epoch.fetch_add(1);
+        if (MidiRouter * router = port->router.load()) router->forward(*port, msg);
+        port->epoch.fetch_add(1);
+
+        if (port->previous) port->previous(msg);
+    };
+
+    return inputs.size() - 1;
+}
+
+size_t MidiRouter::addOutput(MidiOutput & output)
+{
+    outputs.emplace_back(new OutputPort(output));
+    return outputs.size() - 1;
+}
+
+MidiRouter::InputPort & MidiRouter::inputAt(size_t input)
+{
+    if (input >= inputs.size()) throw std::out_of_range("input idx exceeds added inputs");
+    return *inputs[input];
+}
+
+MidiRouter::OutputPort & MidiRouter::outputAt(size_t output)
+{
+    if (output >= outputs.size()) throw std::out_of_range("output idx exceeds added outputs");
+    return *outputs[output];
+}
+
+// Runs on the input thread, with the epoch odd
+void MidiRouter::forward(InputPort & in, const MidiMessageView & msg)
+{
+    const RouteList * routes = in.routes.load();
+
+    if (routes)
+    {
+        for (const auto & route : *routes)
+        {
+            MidiMessageView out = msg;
+            uint8_t rewritten[3];
+            if (route.transform && !route.transform->process(msg, out, rewritten)) continue;
+
+            bool sent = false;
+            try
+            {
+                sent = route.port->output->send(out.data, out.size);
+            }
+            catch (const std::exception &) { } // closed port; nothing may be thrown into the driver thread
+
+            if (sent) thruLatency.record(MonotonicNanos() - msg.timestamp);
+            else ++sendErrors;
+        }
+    }
+}
+
+void MidiRouter::publish(InputPort & in, std::unique_ptr<RouteList> routes)
+{
+    const RouteList * previous = in.routes.exchange(routes.get());
+
+    // The input thread may still be walking the old list
+    if (previous) waitForPass(in);
+
+    in.ownedRoutes.reset(routes.release());
+}
+
+// Waits for the input thread to leave a pass that started before the caller's last store
+void MidiRouter::waitForPass(InputPort & in)
+{
+    const uint64_t epoch = in.epoch.load();
+    if (epoch & 1)
+    {
+        while (in.epoch.load() == epoch) std::this_thread::yield();
+    }
+}
+
+void MidiRouter::connect(size_t input, size_t output, std::unique_ptr<MidiFilter> transform)
+{
+    InputPort & in = inputAt(input);
+    OutputPort * port = &outputAt(output);
+
+    std::unique_ptr<RouteList> routes(in.ownedRoutes ? new RouteList(*in.ownedRoutes) : new RouteList());
+
+    std::shared_ptr<const MidiFilter> shared(transform.release());
+    bool replaced = false;
+    for (auto & route : *routes)
+    {
+        if (route.port != port) continue;
+        route.transform = shared;
+        replaced = true;
+    }
+    if (!replaced) routes->push_back({port, shared});
+
+    publish(in, std::move(routes));
+}
+
+void MidiRouter::disconnect(size_t input, size_t output)
+{
+    InputPort & in = inputAt(input);
+    OutputPort * port = &outputAt(output);
+    if (!in.ownedRoutes) return;
+
+    std::unique_ptr<RouteList> routes(new RouteList());
+    for (const auto & route : *in.ownedRoutes)
+    {
+        if (route.port != port) routes->push_back(route);
+    }
+
+    publish(in, std::move(routes));
+}
+
+void MidiRouter::disconnectAll()
+{
+    for (auto & in : inputs) publish(*in, nullptr);
+}
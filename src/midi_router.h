@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_ROUTER_H
+#define MODERNMIDI_ROUTER_H
+
+#include "modernmidi.h"
+#include "midi_input.h"
+#include "midi_output.h"
+#include "midi_filter.h"
+#include "latency_histogram.h"
+
+#include <vector>
+#include <functional>
+#include <atomic>
+
+namespace mm
+{
+
+// MIDI thru: a matrix connecting any number of inputs to any number of outputs. Incoming
+// bytes are forwarded on the input's own thread straight from the driver buffer, without
+// building a MidiMessage or allocating, optionally through a per-route MidiFilter that can
+// drop, remap or transpose. Routes may be changed while ports are open.
+//
+// Sends to one output from several inputs are serialized by the output itself (see
+// MidiOutput), so an output may also be fed by filters or a sequencer. Thru latency, from the input timestamp to the return of the
+// output driver call, is tracked in a histogram; giving the inputs a realtime
+// configuration (MidiInput::setRealtimeConfig) is the main lever for keeping it low.
+class MidiRouter
+{
+    struct OutputPort
+    {
+        MidiOutput * output;
+        OutputPort(MidiOutput & output) : output(&output) {}
+    };
+
+    struct Route
+    {
+        OutputPort * port;
+        std::shared_ptr<const MidiFilter> transform;
+    };
+
+    typedef std::vector<Route> RouteList;
+
+    // The input thread reads `router` and `routes` with the epoch odd, as MidiInput does
+    // for its filter. Shared with the input's callback, which may outlive the router if
+    // the port is still open when it is destroyed; it then only chains to `previous`.
+    struct InputPort
+    {
+        MidiInput * input;
+        std::function<void (const MidiMessageView & msg)> previous;
+        std::atomic<MidiRouter *> router;
+        std::atomic<const RouteList *> routes;
+        std::unique_ptr<const RouteList> ownedRoutes;
+        std::atomic<uint64_t> epoch;
+        InputPort(MidiInput & input, MidiRouter * router) : input(&input), previous(input.rawMessageCallback), router(router), routes(nullptr), epoch(0) {}
+    };
+
+    std::vector<std::shared_ptr<InputPort>> inputs;
+    std::vector<std::unique_ptr<OutputPort>> outputs;
+
+    LatencyHistogram thruLatency;
+    std::atomic<uint64_t> sendErrors;
+
+    void forward(InputPort & in, const MidiMessageView & msg);
+    void publish(InputPort & in, std::unique_ptr<RouteList> routes);
+    static void waitForPass(InputPort & in);
+    InputPort & inputAt(size_t input);
+    OutputPort & outputAt(size_t output);
+
+public:
+
+    MidiRouter();
+    ~MidiRouter();
+
+    // Installs a forwarding callback on the input, chaining to any rawMessageCallback
+    // already set. Returns the input's index in the matrix. Add inputs before opening
+    // their ports. On destruction the router detaches from every input and puts back the
+    // previous callback on those already closed; open inputs keep a callback that only
+    // chains to the previous one.
+    size_t addInput(MidiInput & input);
+    size_t addOutput(MidiOutput & output);
+
+    // Routes everything from `input` to `output`, through `transform` if given. Connecting
+    // an existing route replaces its transform.
+    void connect(size_t input, size_t output, std::unique_ptr<MidiFilter> transform = nullptr);
+    void disconnect(size_t input, size_t output);
+    void disconnectAll();
+
+    LatencySnapshot getThruLatency() const { return thruLatency.snapshot(); }
+    void resetThruLatency() { thruLatency.reset(); }
+
+    // Messages a driver refused or an output that was closed underneath a route
+    uint64_t getSendErrors() const { return sendErrors; }
+};
+
+} // mm
+
+#endif
@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "midi_time.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(MM_PLATFORM_WINDOWS)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#elif defined(MM_PLATFORM_OSX)
+    #include <mach/mach_time.h>
+#else
+    #include <time.h>
+#endif
+
+using namespace mm;
+
+MidiNanos mm::MonotonicNanos()
+{
+#if defined(MM_PLATFORM_WINDOWS)
+    static const int64_t frequency = []() { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return int64_t(f.QuadPart); }();
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    // Split to keep counter * 1e9 from overflowing
+    const int64_t seconds = counter.QuadPart / frequency;
+    const int64_t remainder = counter.QuadPart % frequency;
+    return seconds * NanosPerSecond + remainder * NanosPerSecond / frequency;
+#elif defined(MM_PLATFORM_OSX)
+    static const mach_timebase_info_data_t info = []() { mach_timebase_info_data_t i; mach_timebase_info(&i); return i; }();
+    const uint64_t t = mach_absolute_time();
+    if (info.numer == info.denom) return MidiNanos(t);
+    return MidiNanos(t / info.denom * info.numer + t % info.denom * info.numer / info.denom);
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return MidiNanos(ts.tv_sec) * NanosPerSecond + ts.tv_nsec;
+#endif
+}
+
+TempoMap::TempoMap(MidiTick ticksPerBeat, double beatsPerMinute) : ticksPerBeat(ticksPerBeat)
+{
+    if (ticksPerBeat <= 0 || beatsPerMinute <= 0) throw std::invalid_argument("tempo map needs a positive resolution and tempo");
+    segments.push_back({0, 0, MidiNanos(60.0 * 1e9 / beatsPerMinute)});
+}
+
+void TempoMap::addTempoChange(MidiTick tick, uint32_t microsecondsPerBeat)
+{
+    if (microsecondsPerBeat == 0) throw std::invalid_argument("tempo change needs a positive duration");
+    if (tick < segments.back().tick) throw std::invalid_argument("tempo changes must be added in tick order");
+
+    Segment s = {tick, toNanos(segments.back(), tick), MidiNanos(microsecondsPerBeat) * 1000};
+
+    if (tick == segments.back().tick) segments.back() = s;
+    else segments.push_back(s);
+}
+
+MidiNanos TempoMap::toNanos(const Segment & s, MidiTick tick) const
+{
+    // Whole beats and the remainder separately, so the product never overflows
+    const MidiTick delta = tick - s.tick;
+    return s.nanos + (delta / ticksPerBeat) * s.nanosPerBeat + (delta % ticksPerBeat) * s.nanosPerBeat / ticksPerBeat;
+}
+
+MidiTick TempoMap::toTick(const Segment & s, MidiNanos nanos) const
+{
+    const MidiNanos delta = nanos - s.nanos;
+    return s.tick + (delta / s.nanosPerBeat) * ticksPerBeat + (delta % s.nanosPerBeat) * ticksPerBeat / s.nanosPerBeat;
+}
+
+size_t TempoMap::segmentAtTick(MidiTick tick) const
+{
+    auto it = std::upper_bound(segments.begin() + 1, segments.end(), tick, [](MidiTick t, const Segment & s) { return t < s.tick; });
+    return size_t(it - segments.begin()) - 1;
+}
+
+size_t TempoMap::segmentAtNanos(MidiNanos nanos) const
+{
+    auto it = std::upper_bound(segments.begin() + 1, segments.end(), nanos, [](MidiNanos n, const Segment & s) { return n < s.nanos; });
+    return size_t(it - segments.begin()) - 1;
+}
+
+MidiNanos TempoMap::nanosAt(MidiTick tick) const
+{
+    return toNanos(segments[segmentAtTick(tick)], tick);
+}
+
+MidiTick TempoMap::tickAt(MidiNanos nanos) const
+{
+    return toTick(segments[segmentAtNanos(nanos)], nanos);
+}
+
+double TempoMap::beatsPerMinuteAt(MidiTick tick) const
+{
+    return 60.0 * 1e9 / double(segments[segmentAtTick(tick)].nanosPerBeat);
+}
+
+MidiNanos TempoMap::Cursor::nanosAt(MidiTick tick)
+{
+    if (segment < map.segments.size() && tick < map.segments[segment].tick) segment = 0;
+    while (segment + 1 < map.segments.size() && map.segments[segment + 1].tick <= tick) ++segment;
+    return map.toNanos(map.segments[segment], tick);
+}
@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_TIME_H
+#define MODERNMIDI_TIME_H
+
+#include "modernmidi.h"
+#include <stdint.h>
+#include <vector>
+
+namespace mm
+{
+    // The library's timeline: musical positions are 64-bit ticks and wall-clock times are
+    // 64-bit nanoseconds. Both are exact integers, so hour-long sessions keep full precision
+    // and results reproduce bit for bit. Floating-point seconds only appear at API edges.
+    typedef int64_t MidiTick;
+    typedef int64_t MidiNanos;
+
+    const MidiNanos NanosPerSecond = 1000000000;
+
+    inline MidiNanos SecondsToNanos(double seconds) { return MidiNanos(seconds * 1e9); }
+    inline double NanosToSeconds(MidiNanos nanos) { return double(nanos) * 1e-9; }
+
+    // Monotonic system time in nanoseconds, shared by input timestamps and the sequencers
+    MidiNanos MonotonicNanos();
+
+    // Piecewise-constant tempo over ticks. Conversions are exact integer arithmetic: a binary
+    // search for random access, or a Cursor for sequential walks, which costs O(1) amortized.
+    class TempoMap
+    {
+        struct Segment
+        {
+            MidiTick tick;
+            MidiNanos nanos;
+            MidiNanos nanosPerBeat;
+        };
+
+        std::vector<Segment> segments;
+        MidiTick ticksPerBeat;
+
+        size_t segmentAtTick(MidiTick tick) const;
+        size_t segmentAtNanos(MidiNanos nanos) const;
+        MidiNanos toNanos(const Segment & s, MidiTick tick) const;
+        MidiTick toTick(const Segment & s, MidiNanos nanos) const;
+
+    public:
+
+        TempoMap(MidiTick ticksPerBeat = 480, double beatsPerMinute = 120);
+
+        // Tempo changes must be added in tick order; a change at the tick of the previous one replaces it
+        void addTempoChange(MidiTick tick, uint32_t microsecondsPerBeat);
+
+        MidiNanos nanosAt(MidiTick tick) const;
+        MidiTick tickAt(MidiNanos nanos) const; // the last tick at or before `nanos`
+
+        MidiTick getTicksPerBeat() const { return ticksPerBeat; }
+        double beatsPerMinuteAt(MidiTick tick) const;
+
+        // Converts ticks in non-decreasing order without searching
+        class Cursor
+        {
+            const TempoMap & map;
+            size_t segment = 0;
+        public:
+            Cursor(const TempoMap & map) : map(map) {}
+            MidiNanos nanosAt(MidiTick tick);
+        };
+    };
+
+} // mm
+
+#endif
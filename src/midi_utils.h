@@ -56,8 +56,8 @@ namespace mm
         {
             for (auto & event_list : tracks)
             {
-                int lastTickValue = 0;
-                int tmpTick = 0;
+                MidiTick lastTickValue = 0;
+                MidiTick tmpTick = 0;
                 for (auto & event : event_list)
                 {
                     const auto msg = event->m;
@@ -77,8 +77,8 @@ namespace mm
         {
             for (auto & event_list : tracks)
             {
-                int runningTickCounter = 0;
-                int tmpTick = 0;
+                MidiTick runningTickCounter = 0;
+                MidiTick tmpTick = 0;
                 for (auto & event : event_list)
                 {
                     const auto msg = event->m;
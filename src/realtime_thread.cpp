@@ -0,0 +1,159 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "realtime_thread.h"
+
+#if defined(MM_PLATFORM_WINDOWS)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+    #include <malloc.h>
+#else
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/mman.h>
+    #include <alloca.h>
+    #include <string.h>
+    #include <errno.h>
+#endif
+
+using namespace mm;
+
+namespace
+{
+    const size_t PageSize = 4096;
+
+    void prefaultStack(size_t bytes)
+    {
+    #if defined(MM_PLATFORM_WINDOWS)
+        volatile uint8_t * stack = static_cast<volatile uint8_t *>(_alloca(bytes));
+    #else
+        volatile uint8_t * stack = static_cast<volatile uint8_t *>(alloca(bytes));
+    #endif
+        for (size_t i = 0; i < bytes; i += PageSize)
+            stack[i] = 0;
+    }
+
+#if !defined(MM_PLATFORM_WINDOWS)
+    std::string errorString(const char * what, int err)
+    {
+        return std::string(what) + " failed: " + strerror(err);
+    }
+#endif
+}
+
+RealtimeConfigResult mm::ApplyRealtimeConfig(const RealtimeThreadConfig & config)
+{
+    RealtimeConfigResult result;
+
+#if defined(MM_PLATFORM_WINDOWS)
+
+    HANDLE threadHandle = GetCurrentThread();
+
+    if (config.priority != ThreadPriority::NORMAL)
+    {
+        const int priority = (config.priority == ThreadPriority::REALTIME) ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+        if (SetThreadPriority(threadHandle, priority) == 0)
+            result.errors.push_back("SetThreadPriority() failed: " + std::to_string(GetLastError()));
+    }
+
+    if (config.affinityMask != 0)
+    {
+        if (SetThreadAffinityMask(threadHandle, (DWORD_PTR) config.affinityMask) == 0)
+            result.errors.push_back("SetThreadAffinityMask() failed: " + std::to_string(GetLastError()));
+    }
+
+    if (config.lockMemory)
+        result.errors.push_back("process-wide memory locking is unsupported on windows");
+
+#else
+
+    pthread_t self = pthread_self();
+
+    if (config.priority == ThreadPriority::REALTIME)
+    {
+        sched_param param;
+        param.sched_priority = mm::clamp(config.fifoPriority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+        const int err = pthread_setschedparam(self, SCHED_FIFO, &param);
+        if (err != 0) result.errors.push_back(errorString("pthread_setschedparam(SCHED_FIFO)", err));
+    }
+    else if (config.priority == ThreadPriority::HIGH)
+    {
+        // Without SCHED_FIFO the best we can portably do is the top of the default policy's range
+        int policy = 0;
+        sched_param param;
+        int err = pthread_getschedparam(self, &policy, &param);
+        if (err == 0)
+        {
+            param.sched_priority = sched_get_priority_max(policy);
+            err = pthread_setschedparam(self, policy, &param);
+        }
+        if (err != 0) result.errors.push_back(errorString("pthread_setschedparam", err));
+    }
+
+    if (config.affinityMask != 0)
+    {
+    #if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; ++cpu)
+            if (config.affinityMask & (uint64_t(1) << cpu)) CPU_SET(cpu, &set);
+        const int err = pthread_setaffinity_np(self, sizeof(set), &set);
+        if (err != 0) result.errors.push_back(errorString("pthread_setaffinity_np", err));
+    #else
+        result.errors.push_back("thread affinity is unsupported on this platform");
+    #endif
+    }
+
+    if (config.lockMemory)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+            result.errors.push_back(errorString("mlockall", errno));
+    }
+
+#endif
+
+    if (config.prefaultStackBytes > 0)
+        prefaultStack(config.prefaultStackBytes);
+
+    return result;
+}
+
+void mm::PrefaultMemory(const void * data, size_t bytes)
+{
+    if (!data || bytes == 0) return;
+
+    const volatile uint8_t * p = static_cast<const volatile uint8_t *>(data);
+    uint8_t sink = 0;
+    for (size_t i = 0; i < bytes; i += PageSize)
+        sink ^= p[i];
+    sink ^= p[bytes - 1];
+    (void) sink;
+}
+
+void mm::ReportRealtimeConfigErrors(const RealtimeConfigResult & result, const char * context)
+{
+    for (const auto & e : result.errors)
+        std::cerr << context << ": " << e << std::endl;
+}
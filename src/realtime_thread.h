@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_REALTIME_THREAD_H
+#define MODERNMIDI_REALTIME_THREAD_H
+
+#include "modernmidi.h"
+#include <thread>
+
+namespace mm
+{
+    enum class ThreadPriority
+    {
+        NORMAL,     // leave the scheduler alone
+        HIGH,       // elevated, but still time-shared
+        REALTIME    // SCHED_FIFO on POSIX, TIME_CRITICAL on Windows
+    };
+
+    struct RealtimeThreadConfig
+    {
+        ThreadPriority priority = ThreadPriority::REALTIME;
+        int fifoPriority = 80;          // 1-99, only used for SCHED_FIFO
+        uint64_t affinityMask = 0;      // bit n pins to cpu n; 0 leaves affinity untouched
+        bool lockMemory = false;        // mlockall(MCL_CURRENT | MCL_FUTURE); affects the whole process
+        size_t prefaultStackBytes = 0;  // touch this much stack up front so the hot loop never faults on it
+    };
+
+    // Each setting is attempted independently; failures are collected instead of thrown
+    // so a thread without the necessary privileges still runs, just less predictably.
+    struct RealtimeConfigResult
+    {
+        std::vector<std::string> errors;
+        bool ok() const { return errors.empty(); }
+    };
+
+    // Must be called on the thread being configured (stack prefaulting can't be done remotely)
+    RealtimeConfigResult ApplyRealtimeConfig(const RealtimeThreadConfig & config);
+
+    // Reads one byte per page so the range is resident before time-critical code touches it
+    void PrefaultMemory(const void * data, size_t bytes);
+
+    // Prints any errors in the result to std::cerr, prefixed with who was being configured
+    void ReportRealtimeConfigErrors(const RealtimeConfigResult & result, const char * context);
+
+} // mm
+
+#endif
@@ -27,12 +27,114 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "sequence_player.h"
 #include "midi_message.h"
 #include "midi_utils.h"
-#include "timer.h"
 
 using namespace mm;
 
-MidiSequencePlayer::MidiSequencePlayer(MidiOutput & output) : shouldSequence(false), output(output)
+void MidiChaseState::reset()
 {
+    for (auto & c : channels)
+    {
+        std::fill(std::begin(c.controllers), std::end(c.controllers), int8_t(-1));
+        c.program = -1;
+        c.channelPressure = -1;
+        c.pitchBend = -1;
+    }
+}
+
+void MidiChaseState::apply(const MidiMessage & msg)
+{
+    if (msg.messageSize() < 2) return;
+
+    const int channel = msg.getChannel();
+    if (channel == 0) return;
+
+    Channel & c = channels[channel - 1];
+
+    switch (msg.getMessageType())
+    {
+        case MessageType::CONTROL_CHANGE:
+        {
+            if (msg.messageSize() < 3) return;
+            const uint8_t cc = msg[1] & 0x7F;
+            if (cc == 121) std::fill(std::begin(c.controllers), std::end(c.controllers), int8_t(-1)); // Reset All Controllers
+            else if (cc < 120) c.controllers[cc] = int8_t(msg[2] & 0x7F); // Channel mode messages are not chased
+            break;
+        }
+        case MessageType::PROGRAM_CHANGE: c.program = int8_t(msg[1] & 0x7F); break;
+        case MessageType::AFTERTOUCH: c.channelPressure = int8_t(msg[1] & 0x7F); break;
+        case MessageType::PITCH_BEND:
+        {
+            if (msg.messageSize() < 3) return;
+            c.pitchBend = int16_t((msg[1] & 0x7F) | ((msg[2] & 0x7F) << 7));
+            break;
+        }
+        default: break;
+    }
+}
+
+static void PutChannelMessage(QueuedMidiMessage & out, MessageType type, uint8_t channel, uint8_t d1, int d2 = -1)
+{
+    out.timestamp = 0;
+    out.delta = 0;
+    out.data[0] = MakeCommand(type, channel);
+    out.data[1] = d1;
+    out.data[2] = d2 >= 0 ? uint8_t(d2) : 0;
+    out.size = d2 >= 0 ? 3 : 2;
+}
+
+size_t MidiChaseState::collect(QueuedMidiMessage * out) const
+{
+    size_t n = 0;
+    for (uint8_t ch = 0; ch < 16; ++ch)
+    {
+        const Channel & c = channels[ch];
+        const uint8_t channel = ch + 1;
+
+        // Bank select must precede the program change it applies to
+        if (c.controllers[0] >= 0) PutChannelMessage(out[n++], MessageType::CONTROL_CHANGE, channel, 0, c.controllers[0]);
+        if (c.controllers[32] >= 0) PutChannelMessage(out[n++], MessageType::CONTROL_CHANGE, channel, 32, c.controllers[32]);
+        if (c.program >= 0) PutChannelMessage(out[n++], MessageType::PROGRAM_CHANGE, channel, uint8_t(c.program));
+
+        for (uint8_t cc = 1; cc < 120; ++cc)
+        {
+            if (cc == 32 || c.controllers[cc] < 0) continue;
+            PutChannelMessage(out[n++], MessageType::CONTROL_CHANGE, channel, cc, c.controllers[cc]);
+        }
+
+        if (c.channelPressure >= 0) PutChannelMessage(out[n++], MessageType::AFTERTOUCH, channel, uint8_t(c.channelPressure));
+        if (c.pitchBend >= 0) PutChannelMessage(out[n++], MessageType::PITCH_BEND, channel, uint8_t(c.pitchBend & 0x7F), (c.pitchBend >> 7) & 0x7F);
+    }
+    return n;
+}
+
+void MidiSequenceSnapshot::buildChaseSnapshots()
+{
+    chaseSnapshots.clear();
+    chaseSnapshots.reserve(events.size() / ChaseSnapshotInterval + 1);
+
+    MidiChaseState state;
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        if (i % ChaseSnapshotInterval == 0) chaseSnapshots.push_back(state);
+        state.apply(*events[i].msg);
+    }
+}
+
+size_t MidiSequenceSnapshot::indexOf(MidiTick tick) const
+{
+    auto it = std::lower_bound(events.begin(), events.end(), tick, [](const MidiPlayerEvent & e, MidiTick t) { return e.tick < t; });
+    return size_t(it - events.begin());
+}
+
+MidiSequencePlayer::MidiSequencePlayer(MidiOutput & output) : shouldSequence(false), pendingSeek(-1), tempo(120.0), playbackRate(1.0), loop(false), 
+    sequence(new MidiSequenceSnapshot()), pendingSequence(nullptr), retiredSequences(nullptr), queueHead(0), queueTail(0), output(output),
+    chaseMessages(ChaseCapacity)
+{
+    for (auto & slot : queued) slot = nullptr;
+
+#if defined(MM_PLATFORM_WINDOWS)
+    realtimeConfig.affinityMask = 1;
+#endif
 
 }
     
@@ -40,22 +142,20 @@ MidiSequencePlayer::~MidiSequencePlayer()
 {
     shouldSequence = false;
 
-    if (sequencerThread.joinable())
-        sequencerThread.join();
-}
+    joinSequencer();
 
-double MidiSequencePlayer::ticksToSeconds(int ticks)
-{
-    double beats = (double) ticks / ticksPerBeat;
-    double seconds = beats / (beatsPerMinute / 60.0);
-    return seconds;
+    delete pendingSequence.load();
+    delete sequence.load();
+    for (auto & slot : queued) delete slot.load();
+    reclaim();
 }
 
-int MidiSequencePlayer::secondsToTicks(float seconds)
+const MidiSequenceSnapshot & MidiSequencePlayer::latestSequence() const
 {
-    double ticksPerSecond = (beatsPerMinute * ticksPerBeat) / 60.0;
-    double ticks = ticksPerSecond * seconds;
-    return (int) ticks;
+    // Whichever snapshot we read stays alive: only the editor thread frees them
+    const MidiSequenceSnapshot * latest = pendingSequence.load(std::memory_order_acquire);
+    if (!latest) latest = sequence.load(std::memory_order_acquire);
+    return *latest;
 }
 
 void MidiSequencePlayer::loadSingleTrack(const MidiTrack & track, double ticksPerBeat, double beatsPerMinute)
@@ -63,18 +163,26 @@ void MidiSequencePlayer::loadSingleTrack(const MidiTrack & track, double ticksPe
     reset();
 
     this->ticksPerBeat = ticksPerBeat;
-    this->beatsPerMinute = float(beatsPerMinute);
-    msPerTick = 60000.0 / beatsPerMinute / ticksPerBeat;
+    tempo = beatsPerMinute;
 
-    double localElapsedTicks = 0;
+    std::unique_ptr<MidiSequenceSnapshot> seq(new MidiSequenceSnapshot());
+    seq->tempoMap = TempoMap(MidiTick(ticksPerBeat), beatsPerMinute);
+
+    MidiTick localElapsedTicks = 0;
+    TempoMap::Cursor timeline(seq->tempoMap);
 
     // Events in track
     for (auto m : track)
     {
         localElapsedTicks += m->tick;
-        double deltaTimestampInSeconds = ticksToSeconds( int(localElapsedTicks) );
-        if (m->m->getMessageType() == MessageType::NOTE_ON) addTimestampedEvent(0, deltaTimestampInSeconds, m); // already checks if non-meta message
+        addTimestampedEvent(*seq, 0, timeline.nanosAt(localElapsedTicks), localElapsedTicks, m); // already checks if non-meta message
     }
+
+    seq->endTick = localElapsedTicks;
+    seq->ticksPerBeat = ticksPerBeat;
+    seq->beatsPerMinute = beatsPerMinute;
+    seq->buildChaseSnapshots();
+    publish(std::move(seq));
 }
 
 void MidiSequencePlayer::loadMultipleTracks(const std::vector<MidiTrack> & tracks, double ticksPerBeat, double beatsPerMinute)
@@ -84,86 +192,561 @@ void MidiSequencePlayer::loadMultipleTracks(const std::vector<MidiTrack> & track
 
 void MidiSequencePlayer::start()
 {
-    if (sequencerThread.joinable()) 
-        sequencerThread.join();
+    joinSequencer();
 
     shouldSequence = true;
-    sequencerThread = std::thread(&MidiSequencePlayer::run, this);
+    sequencerThread = std::thread(&MidiSequencePlayer::threadMain, this);
+    
+    //sequencerThread.detach();
 
-#if defined(MM_PLATFORM_WINDOWS)
-    HANDLE threadHandle = sequencerThread.native_handle();
-    int err = (int)SetThreadPriority(threadHandle, THREAD_PRIORITY_TIME_CRITICAL);
-    if (err == 0)
+    if (startedEvent)
+        startedEvent();
+}
+
+void MidiSequencePlayer::threadMain()
+{
+    prefault();
+    run();
+}
+    
+void MidiSequencePlayer::prefault()
+{
+    ReportRealtimeConfigErrors(ApplyRealtimeConfig(realtimeConfig), "MidiSequencePlayer");
+
+    adoptPendingSequence();
+    const MidiSequenceSnapshot & seq = *sequence.load();
+
+    ticksPerBeat = seq.ticksPerBeat;
+
+    // Touch the event list and every message payload so the first pass doesn't page fault
+    PrefaultMemory(seq.events.data(), seq.events.size() * sizeof(MidiPlayerEvent));
+    for (const auto & ev : seq.events)
     {
-        std::cerr << "SetThreadPriority() failed: " << GetLastError() << std::endl;
+        PrefaultMemory(ev.msg.get(), sizeof(MidiMessage));
+        PrefaultMemory(ev.msg->data.data(), ev.msg->data.size());
     }
 
-    err = (int)SetThreadAffinityMask(threadHandle, 1);
-    if (err == 0)
+    PrefaultMemory(seq.chaseSnapshots.data(), seq.chaseSnapshots.size() * sizeof(MidiChaseState));
+    PrefaultMemory(chaseMessages.data(), chaseMessages.size() * sizeof(QueuedMidiMessage));
+
+    batch.reserve(BatchCapacity);
+    batchDeadlines.reserve(BatchCapacity);
+}
+
+double MidiSequencePlayer::currentTicksPerSecond() const
+{
+    return tempo.load() * playbackRate.load() * ticksPerBeat / 60.0;
+}
+
+bool MidiSequencePlayer::adoptPendingSequence()
+{
+    MidiSequenceSnapshot * next = pendingSequence.exchange(nullptr, std::memory_order_acq_rel);
+    if (!next) return false;
+
+    retireSequence(sequence.exchange(next, std::memory_order_acq_rel));
+    return true;
+}
+
+MidiSequenceSnapshot * MidiSequencePlayer::takeQueuedSequence()
+{
+    const size_t head = queueHead.load(std::memory_order_relaxed);
+    if (head == queueTail.load(std::memory_order_acquire)) return nullptr;
+
+    MidiSequenceSnapshot * next = queued[head % QueueCapacity].exchange(nullptr, std::memory_order_acq_rel);
+    queueHead.store(head + 1, std::memory_order_release);
+
+    retireSequence(sequence.exchange(next, std::memory_order_acq_rel));
+    return next;
+}
+
+void MidiSequencePlayer::retireSequence(MidiSequenceSnapshot * seq)
+{
+    MidiSequenceSnapshot * head = retiredSequences.load(std::memory_order_relaxed);
+    do { seq->retiredNext = head; } while (!retiredSequences.compare_exchange_weak(head, seq, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void MidiSequencePlayer::reclaim()
+{
+    MidiSequenceSnapshot * seq = retiredSequences.exchange(nullptr, std::memory_order_acquire);
+    while (seq)
     {
-        std::cerr<< "SetThreadAffinityMask() failed: " << GetLastError() << std::endl;
+        MidiSequenceSnapshot * next = seq->retiredNext;
+        delete seq;
+        seq = next;
     }
-#endif
-    
-    //sequencerThread.detach();
+}
 
-    if (startedEvent)
-        startedEvent();
+bool MidiSequencePlayer::enqueue(std::unique_ptr<MidiSequenceSnapshot> & next)
+{
+    if (!next) throw std::invalid_argument("cannot enqueue an empty snapshot");
+
+    reclaim();
+
+    const size_t tail = queueTail.load(std::memory_order_relaxed);
+    if (tail - queueHead.load(std::memory_order_acquire) >= QueueCapacity) return false;
+
+    queued[tail % QueueCapacity].store(next.release(), std::memory_order_release);
+    queueTail.store(tail + 1, std::memory_order_release);
+    return true;
 }
-    
+
+void MidiSequencePlayer::publish(std::unique_ptr<MidiSequenceSnapshot> next)
+{
+    if (!next) throw std::invalid_argument("cannot publish an empty snapshot");
+
+    reclaim();
+
+    // A snapshot that was never picked up has never been seen by the sequencer thread
+    delete pendingSequence.exchange(next.release(), std::memory_order_acq_rel);
+}
+
+std::unique_ptr<MidiSequenceSnapshot> MidiSequencePlayer::copySequence() const
+{
+    return std::unique_ptr<MidiSequenceSnapshot>(new MidiSequenceSnapshot(latestSequence()));
+}
+
+void MidiSequencePlayer::joinSequencer()
+{
+    if (sequencerThread.joinable()) 
+        sequencerThread.join();
+}
+
 void MidiSequencePlayer::run()
 {
-    double lastTime = 0;
-    size_t eventCursor = 0;
+    bool sentAnything = false;
+
+    const MidiSequenceSnapshot * seq = sequence.load();
+    MidiTick resumeTick = 0; // events before this tick have been played
+
+    // Position in the event list plus the ticks added by completed loop iterations, so
+    // deadlines keep increasing on one unbroken timeline across every wrap
+    struct Cursor
+    {
+        size_t index = 0;
+        MidiTick offset = 0;
+    };
 
-    PlatformTimer timer;
-    timer.start();
+    Cursor cursor;
 
-    while (eventCursor < eventList.size())
+    SequencerClock & clk = clock ? *clock : platformClock;
+
+    Transport transport;
+    transport.ticksPerSecond = currentTicksPerSecond();
+    transport.locate(clk.now(), 0);
+
+    uint32_t clockGeneration = clockSource ? clockSource->positionGeneration() : 0;
+
+    // When slaved, song position comes from the external clock instead of the local transport
+    auto songTick = [&]() -> double
     {
-        auto outputMsg = eventList[eventCursor];
-        
-        //std::cout << "Delta: " << lastTime - outputMsg.timestamp << std::endl;
+        if (clockSource) return clockSource->beatPositionAt(clk.now()) * ticksPerBeat;
+        return transport.tickAt(clk.now());
+    };
 
-        while((timer.running_time_s()) <= (outputMsg.timestamp))
+    auto nanosPerTick = [&]() -> double
+    {
+        if (clockSource) return 60e9 / (std::max(1.0, clockSource->beatsPerMinute()) * ticksPerBeat);
+        return 1e9 / transport.ticksPerSecond;
+    };
+
+    // Live tempo / rate changes re-anchor the transport at the current position
+    auto applyTempo = [&]()
+    {
+        const double tps = currentTicksPerSecond();
+        if (tps != transport.ticksPerSecond && tps > 0) transport.retime(clk.now(), tps);
+    };
+
+    auto relocated = [&]() -> bool
+    {
+        return clockSource && clockSource->positionGeneration() != clockGeneration;
+    };
+
+    // Clocks are due on an absolute beat grid and are serviced while waiting for events
+    auto serviceClock = [&]()
+    {
+        if (!clockGenerator || !clockGenerator->isRunning()) return;
+        if (clockSource && !clockSource->isRunning()) return;
+        const double due = clockGenerator->nextClockBeat() * ticksPerBeat;
+        const double now = songTick();
+        if (now >= due) clockGenerator->sendClock(MidiNanos((now - due) * nanosPerTick()));
+    };
+
+    auto isDue = [&](MidiTick tick) -> bool
+    {
+        if (clockSource && !clockSource->isRunning()) return false;
+        applyTempo();
+        return songTick() >= double(tick);
+    };
+
+    // Loop region in sequence ticks, [start, end). Without an explicit region the whole
+    // sequence loops, wrapping after its end (or its last event, if that is later).
+    auto loopStart = [&]() -> MidiTick
+    {
+        return loopEndTick > loopStartTick ? loopStartTick : 0;
+    };
+
+    auto loopEnd = [&]() -> MidiTick
+    {
+        if (loopEndTick > loopStartTick) return loopEndTick;
+        const MidiTick lastEvent = seq->events.empty() ? 0 : seq->events.back().tick + 1;
+        return std::max(seq->endTick, lastEvent);
+    };
+
+    // Moves a cursor that has run off the end of the loop region to the start of the next
+    // iteration. Regions without any events don't loop.
+    auto wrap = [&](Cursor & c) -> bool
+    {
+        if (!loop) return false;
+        const MidiTick end = loopEnd();
+        if (c.index < seq->events.size() && seq->events[c.index].tick < end) return false;
+
+        const size_t first = seq->indexOf(loopStart());
+        if (first >= seq->events.size() || seq->events[first].tick >= end) return false;
+
+        c.index = first;
+        c.offset += end - loopStart();
+        return true;
+    };
+
+    auto deadline = [&](const Cursor & c) -> MidiTick
+    {
+        return seq->events[c.index].tick + c.offset;
+    };
+
+    if (clockSource && pendingSeek.load() < 0)
+        pendingSeek = MidiTick(songTick());
+
+    while (shouldSequence)
+    {
+        if (relocated())
         {
-            continue;
+            clockGeneration = clockSource->positionGeneration();
+            pendingSeek = MidiTick(songTick());
         }
 
-        output.send(*outputMsg.msg);
+        // An edited sequence carries on from the same tick
+        if (adoptPendingSequence())
+        {
+            seq = sequence.load();
+            cursor.index = seq->indexOf(resumeTick);
+        }
+
+        MidiTick seekTarget = pendingSeek.exchange(-1);
+        if (seekTarget >= 0)
+        {
+            // A target past the loop region lands at the same phase inside it, otherwise
+            // wrap() would schedule whole iterations in the past
+            const MidiTick start = loopStart(), end = loopEnd();
+            if (loop && seekTarget >= end && end > start)
+                seekTarget = start + (seekTarget - start) % (end - start);
+
+            cursor.index = chase(*seq, seekTarget, sentAnything);
+            cursor.offset = 0;
+            resumeTick = seekTarget;
+            transport.locate(clk.now(), seekTarget);
+            if (clockGenerator) clockGenerator->start(double(seekTarget) / ticksPerBeat);
+        }
+        else if (clockGenerator && !clockGenerator->isRunning())
+        {
+            clockGenerator->start(songTick() / ticksPerBeat);
+        }
+
+        wrap(cursor);
+
+        // The next queued sequence starts where this one ends, in beats, so the transport
+        // and clock output carry straight on even if its resolution or tempo differ
+        if (cursor.index >= seq->events.size() && !loop)
+        {
+            const MidiTick end = cursor.offset + std::max(seq->endTick, seq->events.empty() ? 0 : seq->events.back().tick);
+            const double oldTicksPerBeat = ticksPerBeat;
+
+            if (MidiSequenceSnapshot * next = takeQueuedSequence())
+            {
+                seq = next;
+                ticksPerBeat = seq->ticksPerBeat;
+                tempo = seq->beatsPerMinute;
+
+                const MidiTick start = MidiTick(double(end) / oldTicksPerBeat * ticksPerBeat + 0.5);
+                transport.locate(transport.timeOf(double(end)), double(start));
+                transport.ticksPerSecond = currentTicksPerSecond();
+
+                cursor.index = 0;
+                cursor.offset = start;
+                resumeTick = 0;
+                continue;
+            }
+        }
+
+        const auto & eventList = seq->events;
+
+        if (cursor.index >= eventList.size())
+            break;
+
+        const MidiTick due = deadline(cursor);
+
+        // Everything due within the batch window of this event goes out in the same call,
+        // including the first events of the next loop iteration
+        const double windowTicks = double(batchWindow) / nanosPerTick();
+        Cursor batchEnd = cursor;
+        Cursor lastInBatch = cursor;
+
+        batch.clear();
+        batchDeadlines.clear();
+        do
+        {
+            batch.push_back(eventList[batchEnd.index].msg.get());
+            batchDeadlines.push_back(deadline(batchEnd));
+            lastInBatch = batchEnd;
+            ++batchEnd.index;
+            wrap(batchEnd);
+        }
+        while (batchEnd.index < eventList.size() && double(deadline(batchEnd) - due) <= windowTicks && batch.size() < BatchCapacity);
+
+        auto interrupted = [&]() -> bool
+        {
+            if (pendingSeek.load() >= 0 || relocated()) return true;
+            return pendingSequence.load(std::memory_order_relaxed) != nullptr;
+        };
+
+        while (!isDue(due))
+        {
+            serviceClock();
+            if (interrupted() || shouldSequence == false) break;
+
+            // Slaved deadlines move with the external clock, so only the local transport can predict them
+            MidiNanos wakeTime = clockSource ? clk.now() : transport.timeOf(double(due));
+            if (clockGenerator && !clockSource) wakeTime = std::min(wakeTime, transport.timeOf(clockGenerator->nextClockBeat() * ticksPerBeat));
+            clk.wait(wakeTime, true);
+        }
 
         if (shouldSequence == false) 
             break;
 
-        lastTime = outputMsg.timestamp;
-        eventCursor++;
+        if (interrupted())
+            continue;
+
+        serviceClock();
+
+        const MidiNanos sendStart = clk.now();
+        const double tickAtSend = songTick();
+        output.sendBatch(batch.data(), batch.size());
+        const MidiNanos sendEnd = clk.now();
+        sentAnything = true;
+
+        const double npt = nanosPerTick();
+        for (MidiTick d : batchDeadlines)
+            lateness.record(MidiNanos((tickAtSend - double(d)) * npt));
+        sendDuration.record(sendEnd - sendStart);
+
+        resumeTick = eventList[lastInBatch.index].tick + 1;
+        if (batchEnd.offset != lastInBatch.offset) resumeTick = loopStart();
+        cursor = batchEnd;
     }
 
-    timer.stop(); 
+    if (clockGenerator)
+        clockGenerator->stop();
+
+    shouldSequence = false;
 
-    if (loop && shouldSequence == true) 
-        run();
-        
     if (stoppedEvent)
         stoppedEvent();
 }
 
+size_t MidiSequencePlayer::chase(const MidiSequenceSnapshot & seq, MidiTick tick, bool silenceHangingNotes)
+{
+    size_t count = 0;
+    const size_t cursor = collectChase(seq, tick, silenceHangingNotes, count);
+    output.sendBatch(chaseMessages.data(), count);
+    return cursor;
+}
+
+size_t MidiSequencePlayer::collectChase(const MidiSequenceSnapshot & seq, MidiTick tick, bool silenceHangingNotes, size_t & count)
+{
+    const size_t cursor = seq.indexOf(tick);
+
+    MidiChaseState state;
+    size_t replayFrom = 0;
+
+    if (!seq.chaseSnapshots.empty())
+    {
+        const size_t snapshotIdx = std::min(cursor / MidiSequenceSnapshot::ChaseSnapshotInterval, seq.chaseSnapshots.size() - 1);
+        state = seq.chaseSnapshots[snapshotIdx];
+        replayFrom = snapshotIdx * MidiSequenceSnapshot::ChaseSnapshotInterval;
+    }
+
+    for (size_t i = replayFrom; i < cursor; ++i)
+        state.apply(*seq.events[i].msg);
+
+    // The buffer is sized for the worst case up front, so seeking never allocates
+    QueuedMidiMessage * messages = chaseMessages.data();
+    count = 0;
+
+    if (silenceHangingNotes)
+    {
+        for (uint8_t channel = 1; channel <= 16; ++channel)
+            PutChannelMessage(messages[count++], MessageType::CONTROL_CHANGE, channel, 123, 0); // All Notes Off
+    }
+
+    count += state.collect(messages + count);
+
+    return cursor;
+}
+
+void MidiSequencePlayer::render(std::function<void(const MidiPlayerEvent & ev)> sink)
+{
+    if (shouldSequence) throw std::runtime_error("cannot render while the sequencer is running");
+    if (!sink) throw std::invalid_argument("render requires an event sink");
+
+    if (loop) throw std::runtime_error("cannot render a looping sequence");
+    if (clockSource) throw std::runtime_error("cannot render while slaved to an external clock");
+
+    // The sequencer thread may still be on its way out after stop(). With it gone this
+    // thread stands in for it, so the sequence hand-offs below are safe.
+    joinSequencer();
+    adoptPendingSequence();
+    reclaim();
+
+    const MidiSequenceSnapshot * seq = sequence.load();
+    ticksPerBeat = seq->ticksPerBeat;
+
+    // No waiting: the virtual clock is simply the deadline of the event being emitted, on
+    // the same transport run() schedules against
+    Transport transport;
+    transport.ticksPerSecond = currentTicksPerSecond();
+    transport.locate(0, 0);
+
+    size_t index = 0;
+    MidiTick offset = 0;
+
+    const MidiTick seekTarget = pendingSeek.exchange(-1);
+    if (seekTarget >= 0)
+    {
+        size_t count = 0;
+        index = collectChase(*seq, seekTarget, false, count);
+        transport.locate(0, double(seekTarget));
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const QueuedMidiMessage & q = chaseMessages[i];
+            auto msg = std::make_shared<MidiMessage>(std::vector<uint8_t>(q.data, q.data + q.size));
+            sink(MidiPlayerEvent(0, seekTarget, msg, -1));
+        }
+    }
+
+    for (;;)
+    {
+        for (; index < seq->events.size(); ++index)
+        {
+            MidiPlayerEvent timed(seq->events[index]);
+            timed.timestamp = transport.timeOf(double(timed.tick + offset));
+            sink(timed);
+        }
+
+        // The next queued sequence starts where this one ends, in beats, as in run()
+        const MidiTick end = offset + std::max(seq->endTick, seq->events.empty() ? 0 : seq->events.back().tick);
+        const double oldTicksPerBeat = ticksPerBeat;
+
+        MidiSequenceSnapshot * next = takeQueuedSequence();
+        if (!next) break;
+
+        seq = next;
+        ticksPerBeat = seq->ticksPerBeat;
+        tempo = seq->beatsPerMinute;
+
+        const MidiTick start = MidiTick(double(end) / oldTicksPerBeat * ticksPerBeat + 0.5);
+        transport.locate(transport.timeOf(double(end)), double(start));
+        transport.ticksPerSecond = currentTicksPerSecond();
+
+        index = 0;
+        offset = start;
+    }
+
+    reclaim();
+}
+
 void MidiSequencePlayer::stop()
 {
     shouldSequence = false;
 }
     
-void MidiSequencePlayer::addTimestampedEvent(int track, double when, std::shared_ptr<TrackEvent> ev)
+void MidiSequencePlayer::addTimestampedEvent(MidiSequenceSnapshot & seq, int track, MidiNanos when, MidiTick tick, std::shared_ptr<TrackEvent> ev)
 {
     if (ev->m->isMetaEvent() == false)
     {
-        eventList.push_back(MidiPlayerEvent(when, ev->m, track));
+        seq.events.push_back(MidiPlayerEvent(when, tick, ev->m, track));
     }
 }
 
-float MidiSequencePlayer::length() const
+MidiNanos MidiSequencePlayer::length() const
+{
+    const MidiSequenceSnapshot & seq = latestSequence();
+    return seq.tempoMap.nanosAt(seq.endTick);
+}
+
+void MidiSequencePlayer::seek(MidiNanos position)
+{
+    seekToTick(latestSequence().tempoMap.tickAt(std::max(MidiNanos(0), position)));
+}
+
+void MidiSequencePlayer::seekToTick(MidiTick tick)
 {
-    return playTimeSeconds;
+    pendingSeek = std::max(MidiTick(0), tick);
+}
+
+void MidiSequencePlayer::setTempo(double bpm)
+{
+    if (bpm <= 0) throw std::invalid_argument("tempo must be positive");
+    tempo = bpm;
+}
+
+void MidiSequencePlayer::setPlaybackRate(double rate)
+{
+    if (rate <= 0) throw std::invalid_argument("playback rate must be positive");
+    playbackRate = rate;
+}
+
+MidiSequencePlayer::TimingStats MidiSequencePlayer::getTimingStats() const
+{
+    TimingStats stats;
+    stats.lateness = lateness.snapshot();
+    stats.sendDuration = sendDuration.snapshot();
+    return stats;
+}
+
+void MidiSequencePlayer::resetTimingStats()
+{
+    lateness.reset();
+    sendDuration.reset();
+}
+
+void MidiSequencePlayer::setClock(SequencerClock * newClock)
+{
+    if (shouldSequence) throw std::runtime_error("cannot change the clock while the sequencer is running");
+    clock = newClock;
+}
+
+void MidiSequencePlayer::setClockSource(MidiClockFollower * follower)
+{
+    if (shouldSequence) throw std::runtime_error("cannot change the clock source while the sequencer is running");
+    clockSource = follower;
+}
+
+void MidiSequencePlayer::setClockOutput(MidiOutput * clockOutput)
+{
+    if (shouldSequence) throw std::runtime_error("cannot change the clock output while the sequencer is running");
+    if (clockOutput) clockGenerator.reset(new MidiClockGenerator(*clockOutput));
+    else clockGenerator.reset();
+}
+
+LatencySnapshot MidiSequencePlayer::getClockJitter() const
+{
+    if (!clockGenerator) return LatencySnapshot();
+    return clockGenerator->getJitter();
+}
+
+void MidiSequencePlayer::setBatchWindow(MidiNanos window)
+{
+    batchWindow = std::max(MidiNanos(0), window);
 }
 
 void MidiSequencePlayer::setLooping(bool newState)
@@ -171,10 +754,17 @@ void MidiSequencePlayer::setLooping(bool newState)
     loop = newState;
 }
 
+void MidiSequencePlayer::setLoopRegion(MidiTick startTick, MidiTick endTick)
+{
+    if (shouldSequence) throw std::runtime_error("cannot change the loop region while the sequencer is running");
+    if (startTick < 0 || (endTick != 0 && endTick <= startTick)) throw std::invalid_argument("invalid loop region");
+    loopStartTick = startTick;
+    loopEndTick = endTick;
+    loop = true;
+}
+
 void MidiSequencePlayer::reset()
 {
-    eventList.clear();
-    eventCursor = 0;
-    startTime = 0;
-    playTimeSeconds = 0;
+    publish(std::unique_ptr<MidiSequenceSnapshot>(new MidiSequenceSnapshot()));
+    pendingSeek = -1;
 }
@@ -32,6 +32,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "concurrent_queue.h"
 #include "midi_message.h"
 #include "midi_file_reader.h"
+#include "realtime_thread.h"
+#include "latency_histogram.h"
+#include "midi_clock.h"
+#include "sequencer_clock.h"
 
 #include <functional>
 #include <thread>
@@ -43,47 +47,268 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace mm 
 {
 
+// Controller / program / pitch bend state of all 16 channels at some point in a sequence.
+// Used to "chase" the state a device should be in after seeking past the events that set it.
+struct MidiChaseState
+{
+    struct Channel
+    {
+        int8_t controllers[128]; // -1 when never set
+        int8_t program;
+        int8_t channelPressure;
+        int16_t pitchBend; // 14-bit value, -1 when never set
+    };
+
+    Channel channels[16];
+
+    MidiChaseState() { reset(); }
+
+    void reset();
+    void apply(const MidiMessage & msg);
+
+    // Writes the minimal set of messages that recreates this state: bank select, program,
+    // remaining controllers (including sustain), pressure and pitch bend. `out` must have
+    // room for MaxCollected messages; returns how many were written.
+    static const size_t MaxCollected = 16 * 123;
+    size_t collect(QueuedMidiMessage * out) const;
+};
+
+// An immutable version of a sequence as the sequencer thread plays it. Editors build a new
+// one off-thread (usually starting from MidiSequencePlayer::copySequence), fill `events`
+// sorted by tick, call buildChaseSnapshots and hand it to MidiSequencePlayer::publish
+// (to replace what is playing) or MidiSequencePlayer::enqueue (to play after it).
+struct MidiSequenceSnapshot
+{
+    std::vector<MidiPlayerEvent> events;
+    MidiTick endTick = 0; // where whole-sequence looping wraps and queued sequences take over
+
+    // Adopted by the player when an enqueued snapshot takes over
+    double ticksPerBeat = 480;
+    double beatsPerMinute = 120;
+
+    // Timeline the events are timed against, at ticksPerBeat and beatsPerMinute. Event
+    // timestamps, seek(MidiNanos) and length() read it from the snapshot being played.
+    TempoMap tempoMap;
+
+    MidiSequenceSnapshot * retiredNext = nullptr; // link in the player's retired list
+
+    // First event at or after `tick`
+    size_t indexOf(MidiTick tick) const;
+
+    // chaseSnapshots[k] holds the state before event k * ChaseSnapshotInterval
+    static const size_t ChaseSnapshotInterval = 128;
+    std::vector<MidiChaseState> chaseSnapshots;
+
+    void buildChaseSnapshots();
+};
+
 // This class is always a work in progress, and does not currently handle things like
 // mid-track tempo changes.
 class MidiSequencePlayer 
 {
     MidiOutput & output;
+
+    // Maps clock time to song ticks around an anchor point. Tempo changes re-anchor at the
+    // current position, so no event needs re-timing. Only the (small) distance from the
+    // anchor is ever scaled, so precision doesn't degrade over long sessions.
+    struct Transport
+    {
+        MidiNanos anchorTime = 0;
+        double anchorTick = 0;
+        double ticksPerSecond = 1;
+
+        double tickAt(MidiNanos t) const { return anchorTick + NanosToSeconds(t - anchorTime) * ticksPerSecond; }
+        MidiNanos timeOf(double tick) const { return anchorTime + SecondsToNanos((tick - anchorTick) / ticksPerSecond); }
+        void locate(MidiNanos t, double tick) { anchorTime = t; anchorTick = tick; }
+        void retime(MidiNanos t, double newTicksPerSecond) { anchorTick = tickAt(t); anchorTime = t; ticksPerSecond = newTicksPerSecond; }
+    };
+
+    double currentTicksPerSecond() const;
     
+    void threadMain();
+    void prefault();
     void run();
+
+    // Finds the first event at or after `tick`, emits the chased state for that
+    // position and returns the event index. Runs on the sequencer thread.
+    size_t chase(const MidiSequenceSnapshot & seq, MidiTick tick, bool silenceHangingNotes);
+
+    // chase() without the send: fills chaseMessages and sets `count`
+    size_t collectChase(const MidiSequenceSnapshot & seq, MidiTick tick, bool silenceHangingNotes, size_t & count);
+
+    // Sequencer thread: installs a published snapshot if there is one. Never blocks,
+    // allocates or frees.
+    bool adoptPendingSequence();
+
+    // Sequencer thread: replaces the current snapshot with the next enqueued one, if any
+    MidiSequenceSnapshot * takeQueuedSequence();
+
+    // Sequencer thread: pushes a snapshot it no longer uses onto the retired list
+    void retireSequence(MidiSequenceSnapshot * seq);
+
+    void joinSequencer();
     
     // Default behavior of this function is to reject playing any metadata events
-    void addTimestampedEvent(int track, double when, std::shared_ptr<TrackEvent> ev);
+    void addTimestampedEvent(MidiSequenceSnapshot & seq, int track, MidiNanos when, MidiTick tick, std::shared_ptr<TrackEvent> ev);
     
-    double ticksToSeconds(int ticks);
-    
-    int secondsToTicks(float seconds);
+    // The most recently published snapshot, as copySequence sees it
+    const MidiSequenceSnapshot & latestSequence() const;
 
-    float beatsPerMinute;
-    double ticksPerBeat;
-    double msPerTick;
-    
-    float playTimeSeconds = 0;
-    float startTime = 0;
-    int eventCursor = 0;
+    double ticksPerBeat = 480;
     
     std::thread sequencerThread;
     std::atomic<bool> shouldSequence;
-    bool loop = false;
+    std::atomic<MidiTick> pendingSeek; // negative when there is none
+    std::atomic<double> tempo;
+    std::atomic<double> playbackRate;
+    std::atomic<bool> loop;
+    MidiTick loopStartTick = 0;
+    MidiTick loopEndTick = 0; // a region is set when greater than loopStartTick
+
+    SequencerClock * clock = nullptr;
+    PlatformSequencerClock platformClock;
+
+    MidiClockFollower * clockSource = nullptr;
+    std::unique_ptr<MidiClockGenerator> clockGenerator;
+
+    MidiNanos batchWindow = 0;
+    static const size_t BatchCapacity = 128;
+    std::vector<const MidiMessage *> batch;
+    std::vector<MidiTick> batchDeadlines;
+
+    LatencyHistogram lateness;
+    LatencyHistogram sendDuration;
+
+    // Messages sent by chase(): All Notes Off on every channel plus the chased state
+    static const size_t ChaseCapacity = 16 + MidiChaseState::MaxCollected;
+    std::vector<QueuedMidiMessage> chaseMessages;
+
+    // RCU-style hand-over: the editor fills `pendingSequence`, the sequencer thread moves it
+    // into `sequence` and pushes the old one onto `retiredSequences` for the editor to free.
+    std::atomic<MidiSequenceSnapshot *> sequence;
+    std::atomic<MidiSequenceSnapshot *> pendingSequence;
+    std::atomic<MidiSequenceSnapshot *> retiredSequences;
+
+    // Single-producer single-consumer ring of snapshots to play back to back
+    static const size_t QueueCapacity = 8;
+    std::atomic<MidiSequenceSnapshot *> queued[QueueCapacity];
+    std::atomic<size_t> queueHead; // next slot the sequencer thread takes
+    std::atomic<size_t> queueTail; // next slot the editor fills
     
 public:
 
     MidiSequencePlayer(MidiOutput & output);
     ~MidiSequencePlayer();
         
+    // Loading replaces the sequence and resets the tempo. Not for use while playing;
+    // edit a playing sequence through copySequence / publish instead.
     void loadSingleTrack(const MidiTrack & track, double ticksPerBeat = 480, double beatsPerMinute = 120);
     void loadMultipleTracks(const std::vector<MidiTrack> & tracks, double ticksPerBeat = 480, double beatsPerMinute = 120);
 
     void start();
     void stop();
 
+    // Non-realtime mode: plays on a virtual clock that jumps straight to each deadline,
+    // handing every event to the sink with the timestamp run() would schedule it at. Like
+    // playback it starts from a pending seek (chased state first, at time zero, with track
+    // -1), uses the current tempo and playback rate, and carries on into queued sequences,
+    // adopting their resolution and tempo; both are consumed. The output device is not
+    // touched. Throws if the sequencer thread is running, or if looping or slaved to an
+    // external clock, which have no end or no timeline to render against.
+    void render(std::function<void(const MidiPlayerEvent & ev)> sink);
+
+    // Loops the whole sequence, or the loop region if one is set. Playback wraps on one
+    // continuous timeline: the first event of the next iteration is due exactly one loop
+    // length after the first event of the previous one, with no gap or drift however long
+    // it runs. Notes still sounding at the end of the region are not released. Safe to
+    // call while playing.
     void setLooping(bool newState);
 
-    float length() const;
+    // Loops ticks [startTick, endTick) and enables looping. An endTick of 0 clears the
+    // region so the whole sequence loops again. Set before start().
+    void setLoopRegion(MidiTick startTick, MidiTick endTick);
+
+    // Time base of the sequencer thread; nullptr (the default) uses the hardware timer.
+    // Pass a ManualSequencerClock to step playback deterministically. Set before start().
+    void setClock(SequencerClock * newClock);
+
+    // Slave mode: when set, playback follows the follower's START / STOP / song position and
+    // its smoothed tempo instead of the local timer. Deadlines are re-evaluated against the
+    // latest estimate every time they are polled, so the event list is never rebuilt. Song
+    // position maps to the event list at the tempo it was loaded with. The follower must run
+    // on the same clock as the player (see setClock). Pass nullptr to return to the internal
+    // clock. Set before start().
+    void setClockSource(MidiClockFollower * follower);
+
+    // Master mode: emits 24 PPQN clock and transport messages on clockOutput (which may be
+    // the sequence output) from the sequencer thread, interleaved with sequence events.
+    // Pass nullptr to disable. Set before start().
+    void setClockOutput(MidiOutput * clockOutput);
+
+    // Lateness of generated clocks against their ideal deadlines
+    LatencySnapshot getClockJitter() const;
+
+    // Events whose deadlines fall within this window (at the current tempo) of the first pending event are
+    // handed to the output together in one sendBatch call, at the first event's deadline.
+    // The default of zero only groups events sharing an exact timestamp (chords, drum hits).
+    // Set before start().
+    void setBatchWindow(MidiNanos window);
+
+    // Moves the play position in O(log n). Controllers, programs and pitch bend set before
+    // the new position are re-sent before playback resumes. Safe to call while playing;
+    // the sequencer thread picks the request up at the next event boundary. Times are
+    // measured on the tempo map of the most recently published snapshot, so seek by time
+    // from the editor thread (see publish).
+    void seek(MidiNanos position);
+    void seekToTick(MidiTick tick);
+
+    // Live tempo (beats per minute) and playback rate (multiplier on top of the tempo).
+    // Safe to call from any thread while playing; the sequencer picks the new value up the
+    // next time it computes a deadline, so ramps built from repeated calls take effect within
+    // one event, without allocating or touching the event list. Loading resets the tempo to
+    // the loaded value; the rate is kept. Ignored while slaved to an external clock.
+    void setTempo(double bpm);
+    double getTempo() const { return tempo; }
+    void setPlaybackRate(double rate);
+    double getPlaybackRate() const { return playbackRate; }
+
+    // Live editing. publish hands over a new snapshot and returns immediately; the sequencer
+    // thread swaps it in at the next event boundary and carries on from the same tick, so
+    // edits never block or race playback. A snapshot published while another is still
+    // pending replaces it. copySequence returns a copy of the most recently published
+    // version to edit. Call both from a single editor thread.
+    void publish(std::unique_ptr<MidiSequenceSnapshot> next);
+    std::unique_ptr<MidiSequenceSnapshot> copySequence() const;
+
+    // Queues a snapshot to start where the current one ends (at its endTick), on the same
+    // timeline: the sequencer switches over without stopping, allocating or waiting, and
+    // adopts the snapshot's ticksPerBeat and beatsPerMinute. Ignored while looping. Returns
+    // false, leaving `next` untouched, when the queue is full. Same thread rules as publish.
+    bool enqueue(std::unique_ptr<MidiSequenceSnapshot> & next);
+    size_t queuedSequences() const { return queueTail - queueHead; }
+
+    // Frees snapshots the sequencer thread has finished with. publish and enqueue do this
+    // too; call it from the editor thread if neither is called for a long time.
+    void reclaim();
+
+    // How late each event left compared with its scheduled time, and how long
+    // each MidiOutput::sendBatch call took. Safe to call from any thread while playing.
+    struct TimingStats
+    {
+        LatencySnapshot lateness;
+        LatencySnapshot sendDuration;
+    };
+
+    TimingStats getTimingStats() const;
+    void resetTimingStats();
+
+    // Applied by the sequencer thread to itself when it starts. Failures are reported on
+    // std::cerr and playback continues. Defaults to REALTIME priority (pinned to the first
+    // core on Windows, as before).
+    RealtimeThreadConfig realtimeConfig;
+
+    // On the tempo map of the most recently published snapshot; same thread rules as publish
+    MidiNanos length() const;
     
     void reset();
 
@@ -93,8 +318,6 @@ public:
     std::function<void(const MidiPlayerEvent ev)> eventCallback;
 
     ConcurrentQueue<MidiPlayerEvent> eventQueue;
-
-    std::vector<MidiPlayerEvent> eventList; // indexed by track
 };
 
 } // mm
@@ -0,0 +1,248 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sequence_scheduler.h"
+
+using namespace mm;
+
+MidiSequenceScheduler::MidiSequenceScheduler(MidiNanos resolution, size_t wheelSlots) : resolution(resolution), incoming(nullptr), retired(nullptr), activeCount(std::make_shared<std::atomic<size_t>>(0)), shouldRun(false)
+{
+    if (resolution <= 0) throw std::invalid_argument("scheduler resolution must be positive");
+
+    size_t slots = 1;
+    while (slots < wheelSlots) slots <<= 1;
+
+    wheel.assign(slots, nullptr);
+    wheelMask = slots - 1;
+}
+
+MidiSequenceScheduler::~MidiSequenceScheduler()
+{
+    stop();
+
+    auto freeList = [](Voice * v)
+    {
+        while (v)
+        {
+            Voice * next = v->next;
+            delete v;
+            v = next;
+        }
+    };
+
+    for (auto & slot : wheel) freeList(slot);
+    freeList(imminent);
+    freeList(incoming.exchange(nullptr));
+    reclaim();
+}
+
+void MidiSequenceScheduler::start()
+{
+    if (schedulerThread.joinable()) 
+        schedulerThread.join();
+
+    shouldRun = true;
+    schedulerThread = std::thread(&MidiSequenceScheduler::run, this);
+}
+
+void MidiSequenceScheduler::setClock(SequencerClock * newClock)
+{
+    if (shouldRun) throw std::runtime_error("cannot change the clock while the scheduler is running");
+    clock = newClock;
+}
+
+void MidiSequenceScheduler::stop()
+{
+    shouldRun = false;
+
+    if (schedulerThread.joinable())
+        schedulerThread.join();
+}
+
+std::shared_ptr<ScheduledSequence> MidiSequenceScheduler::schedule(std::shared_ptr<const std::vector<MidiPlayerEvent>> events, MidiOutput & output, MidiNanos delay)
+{
+    if (!events) throw std::invalid_argument("null event list");
+
+    // Free whatever the scheduler thread finished with since the last call
+    reclaim();
+
+    auto handle = std::make_shared<ScheduledSequence>();
+    handle->activeCount = activeCount;
+    handle->counted = true;
+    ++*activeCount;
+
+    Voice * v = new Voice();
+    v->events = events;
+    v->handle = handle;
+    v->output = &output;
+    v->delay = std::max(MidiNanos(0), delay);
+
+    Voice * head = incoming.load();
+    do { v->next = head; } while (!incoming.compare_exchange_weak(head, v));
+
+    return handle;
+}
+
+void MidiSequenceScheduler::reclaim()
+{
+    Voice * v = retired.exchange(nullptr);
+    while (v)
+    {
+        Voice * next = v->next;
+        delete v;
+        v = next;
+    }
+}
+
+void MidiSequenceScheduler::retire(Voice * v)
+{
+    v->handle->finished = true;
+    v->handle->uncount();
+
+    Voice * head = retired.load();
+    do { v->next = head; } while (!retired.compare_exchange_weak(head, v));
+}
+
+void MidiSequenceScheduler::insert(Voice * v)
+{
+    v->deadline = v->startTime + (*v->events)[v->cursor].timestamp;
+    v->deadlineTick = toTick(v->deadline);
+
+    if (v->deadlineTick < wheelTick)
+    {
+        v->next = imminent;
+        imminent = v;
+    }
+    else
+    {
+        Voice *& slot = wheel[size_t(v->deadlineTick) & wheelMask];
+        v->next = slot;
+        slot = v;
+    }
+}
+
+void MidiSequenceScheduler::acceptIncoming(MidiNanos now)
+{
+    Voice * v = incoming.exchange(nullptr);
+    while (v)
+    {
+        Voice * next = v->next;
+        v->startTime = now + v->delay;
+        if (v->events->empty() || v->handle->cancelled) retire(v);
+        else insert(v);
+        v = next;
+    }
+}
+
+void MidiSequenceScheduler::run()
+{
+    ReportRealtimeConfigErrors(ApplyRealtimeConfig(realtimeConfig), "MidiSequenceScheduler");
+
+    SequencerClock & clk = clock ? *clock : platformClock;
+    const MidiNanos origin = clk.now();
+
+    wheelTick = 0;
+
+    while (shouldRun)
+    {
+        MidiNanos now = clk.now() - origin;
+
+        acceptIncoming(now);
+
+        // Advance the wheel, moving every voice whose deadline tick has arrived onto the imminent list
+        const int64_t nowTick = toTick(now);
+        while (wheelTick <= nowTick)
+        {
+            Voice *& slot = wheel[size_t(wheelTick) & wheelMask];
+            Voice * v = slot;
+            slot = nullptr;
+            while (v)
+            {
+                Voice * next = v->next;
+                if (v->deadlineTick > wheelTick)
+                {
+                    // Belongs to a later revolution
+                    v->next = slot;
+                    slot = v;
+                }
+                else
+                {
+                    v->next = imminent;
+                    imminent = v;
+                }
+                v = next;
+            }
+            ++wheelTick;
+        }
+
+        // Fire everything that is due, re-inserting voices that still have events left
+        Voice * due = imminent;
+        imminent = nullptr;
+        now = clk.now() - origin;
+
+        while (due)
+        {
+            Voice * v = due;
+            due = due->next;
+
+            if (v->handle->cancelled)
+            {
+                retire(v);
+                continue;
+            }
+
+            if (v->deadline > now)
+            {
+                v->next = imminent;
+                imminent = v;
+                continue;
+            }
+
+            const auto & events = *v->events;
+            while (v->cursor < events.size() && v->startTime + events[v->cursor].timestamp <= now)
+            {
+                v->output->send(*events[v->cursor].msg);
+                ++v->cursor;
+            }
+
+            if (v->cursor >= events.size())
+            {
+                if (sequenceFinished) sequenceFinished(v->handle);
+                retire(v);
+            }
+            else insert(v);
+        }
+
+        // Spin while something is about to fire, otherwise sleep until the next slot
+        if (imminent)
+        {
+            MidiNanos earliest = imminent->deadline;
+            for (Voice * v = imminent->next; v; v = v->next) earliest = std::min(earliest, v->deadline);
+            clk.wait(origin + earliest, true);
+            std::this_thread::yield();
+        }
+        else clk.wait(origin + wheelTick * resolution, false);
+    }
+}
@@ -0,0 +1,138 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_SEQUENCE_SCHEDULER_H
+#define MODERNMIDI_SEQUENCE_SCHEDULER_H
+
+#include "modernmidi.h"
+#include "midi_event.h"
+#include "midi_output.h"
+#include "realtime_thread.h"
+#include "sequencer_clock.h"
+
+#include <functional>
+#include <thread>
+#include <atomic>
+
+namespace mm
+{
+
+// Handle to a sequence submitted to a MidiSequenceScheduler. Shared between the
+// submitting thread and the scheduler thread; all members are safe to call from either.
+class ScheduledSequence
+{
+    friend class MidiSequenceScheduler;
+    std::atomic<bool> cancelled;
+    std::atomic<bool> finished;
+
+    // Whichever of cancel() and the scheduler's retire gets here first takes the sequence
+    // off the active count, so a cancel is reflected at once rather than when its slot
+    // comes due. Shared so a handle may outlive its scheduler.
+    std::atomic<bool> counted;
+    std::shared_ptr<std::atomic<size_t>> activeCount;
+    void uncount() { if (counted.exchange(false)) --*activeCount; }
+public:
+    ScheduledSequence() : cancelled(false), finished(false), counted(false) {}
+    void cancel() { cancelled = true; uncount(); }
+    bool isFinished() const { return finished; }
+};
+
+// Plays any number of event lists on any number of outputs from a single thread.
+// Pending sequences are kept in a hashed timer wheel, so inserting, advancing and firing
+// are O(1) per event regardless of how many sequences are in flight. Sequences
+// scheduled further out than one wheel revolution simply wait in their slot for
+// additional rounds.
+class MidiSequenceScheduler
+{
+    struct Voice
+    {
+        std::shared_ptr<const std::vector<MidiPlayerEvent>> events;
+        std::shared_ptr<ScheduledSequence> handle;
+        MidiOutput * output = nullptr;
+        size_t cursor = 0;
+        MidiNanos delay = 0;       // after submission, resolved on the scheduler thread
+        MidiNanos startTime = 0;   // scheduler time of the sequence's t = 0
+        MidiNanos deadline = 0;    // scheduler time of events[cursor]
+        int64_t deadlineTick = 0;
+        Voice * next = nullptr;
+    };
+
+    void run();
+    void acceptIncoming(MidiNanos now);
+    void insert(Voice * v);
+    void retire(Voice * v);
+    void reclaim();
+
+    int64_t toTick(MidiNanos time) const { return time / resolution; }
+
+    std::vector<Voice *> wheel;
+    size_t wheelMask;
+    int64_t wheelTick = 0;
+    MidiNanos resolution;
+
+    Voice * imminent = nullptr; // deadline tick already reached, waiting for the exact deadline
+
+    std::atomic<Voice *> incoming;  // multi-producer stack, emptied in one exchange by the scheduler
+    std::atomic<Voice *> retired;   // pushed by the scheduler, freed off the real-time thread
+    std::shared_ptr<std::atomic<size_t>> activeCount; // shared with every handle
+
+    std::thread schedulerThread;
+    std::atomic<bool> shouldRun;
+
+    SequencerClock * clock = nullptr;
+    PlatformSequencerClock platformClock;
+
+public:
+
+    // resolution is the wheel slot width; wheelSlots is rounded up to a power of two
+    MidiSequenceScheduler(MidiNanos resolution = 1000000, size_t wheelSlots = 1024);
+    ~MidiSequenceScheduler();
+
+    void start();
+    void stop();
+
+    // Time base of the scheduler thread; nullptr (the default) uses the hardware timer.
+    // Scheduler time starts at zero when start() is called. Set before start().
+    void setClock(SequencerClock * newClock);
+
+    // Thread-safe. The sequence starts `delay` after the scheduler thread picks it up.
+    // Event timestamps are relative to the start of the sequence and must be sorted.
+    std::shared_ptr<ScheduledSequence> schedule(std::shared_ptr<const std::vector<MidiPlayerEvent>> events, MidiOutput & output, MidiNanos delay = 0);
+
+    // Number of sequences submitted but not yet finished or cancelled
+    size_t activeSequences() const { return *activeCount; }
+
+    // Applied by the scheduler thread to itself when it starts; failures are reported on std::cerr
+    RealtimeThreadConfig realtimeConfig;
+
+    // Invoked on the scheduler thread when a sequence plays its last event
+    std::function<void(const std::shared_ptr<ScheduledSequence> & seq)> sequenceFinished;
+};
+
+} // mm
+
+#endif
@@ -0,0 +1,80 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sequencer_clock.h"
+
+#include <thread>
+#include <chrono>
+
+using namespace mm;
+
+void PlatformSequencerClock::wait(MidiNanos deadline, bool spin)
+{
+    if (spin) return;
+
+    const MidiNanos remaining = deadline - now();
+    if (remaining > 0) std::this_thread::sleep_for(std::chrono::nanoseconds(remaining));
+}
+
+ManualSequencerClock::ManualSequencerClock(MidiNanos start) : time(start)
+{
+
+}
+
+void ManualSequencerClock::wait(MidiNanos deadline, bool /*spin*/)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // Time moved past the deadline since the caller last looked: it has work to do
+    if (time >= deadline) return;
+
+    idleGeneration = generation;
+    changed.notify_all();
+
+    const uint64_t seen = generation;
+    changed.wait_for(lock, std::chrono::milliseconds(1), [&] { return generation != seen; });
+}
+
+void ManualSequencerClock::advance(MidiNanos nanos)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    time = time + nanos;
+    ++generation;
+    changed.notify_all();
+}
+
+void ManualSequencerClock::advanceTo(MidiNanos nanos)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    time = nanos;
+    ++generation;
+    changed.notify_all();
+}
+
+bool ManualSequencerClock::waitForIdle(double timeoutSeconds)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return changed.wait_for(lock, std::chrono::microseconds(int64_t(timeoutSeconds * 1e6)), [&] { return idleGeneration == generation; });
+}
@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_SEQUENCER_CLOCK_H
+#define MODERNMIDI_SEQUENCER_CLOCK_H
+
+#include "modernmidi.h"
+#include "midi_time.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace mm
+{
+    // Time base for the sequencer threads. The player and scheduler read time and wait
+    // exclusively through this interface, so a simulated clock can stand in for the
+    // hardware timer and drive their scheduling logic deterministically.
+    class SequencerClock
+    {
+    public:
+        virtual ~SequencerClock() {}
+
+        // Nanoseconds on a monotonic timeline; only differences are meaningful
+        virtual MidiNanos now() = 0;
+
+        // Called by a sequencer thread with nothing due before `deadline` (on this clock).
+        // May return early; callers re-check their state and call again. With spin set the
+        // caller wants a short busy-wait step rather than a sleep.
+        virtual void wait(MidiNanos deadline, bool spin) = 0;
+    };
+
+    // MonotonicNanos. Spinning returns straight away; sleeping uses the OS scheduler.
+    class PlatformSequencerClock : public SequencerClock
+    {
+    public:
+        MidiNanos now() override { return MonotonicNanos(); }
+        void wait(MidiNanos deadline, bool spin) override;
+    };
+
+    // Simulated time that only moves when advanced. A sequencer thread waiting on it blocks
+    // until the clock passes its deadline (or briefly, so it still notices stop and seek
+    // requests). waitForIdle lets a test step time and then observe exactly what was sent.
+    class ManualSequencerClock : public SequencerClock
+    {
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::atomic<MidiNanos> time;
+        uint64_t generation = 0;        // bumped on every advance
+        uint64_t idleGeneration = ~uint64_t(0); // generation a sequencer last went idle at
+
+    public:
+        ManualSequencerClock(MidiNanos start = 0);
+
+        MidiNanos now() override { return time; }
+        void wait(MidiNanos deadline, bool spin) override;
+
+        void advance(MidiNanos nanos);
+        void advanceTo(MidiNanos nanos);
+
+        // Blocks until a sequencer thread has caught up with the current time and is waiting
+        // for a later deadline. Returns false on timeout, e.g. once playback has finished.
+        bool waitForIdle(double timeoutSeconds = 1.0);
+    };
+
+} // mm
+
+#endif
@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_SPSC_RING_H
+#define MODERNMIDI_SPSC_RING_H
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace mm
+{
+
+// Bounded single-producer / single-consumer ring. push() and pop() are wait-free and never
+// allocate, so the producer side may run on a driver or audio thread. The capacity is rounded
+// up to a power of two. Exactly one thread may push and exactly one thread may pop.
+template<typename T>
+class SpscRing
+{
+    std::vector<T> slots;
+    size_t mask;
+
+    // Each index is written by one side only; padding keeps them on separate cache lines
+    // without making the ring over-aligned, which C++11 heap allocation can't honour
+    struct PaddedIndex
+    {
+        std::atomic<size_t> value;
+        char pad[64];
+        PaddedIndex() : value(0) {}
+    };
+
+    PaddedIndex head; // next slot to pop
+    PaddedIndex tail; // next slot to push
+
+    static size_t roundUp(size_t n)
+    {
+        size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+public:
+
+    SpscRing(size_t capacity) : slots(roundUp(capacity < 2 ? 2 : capacity))
+    {
+        mask = slots.size() - 1;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing & operator = (const SpscRing &) = delete;
+
+    size_t capacity() const { return slots.size(); }
+
+    // Producer side. Returns false, leaving the ring untouched, when it is full.
+    bool push(const T & value)
+    {
+        const size_t t = tail.value.load(std::memory_order_relaxed);
+        if (t - head.value.load(std::memory_order_acquire) == slots.size()) return false;
+        slots[t & mask] = value;
+        tail.value.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side. Free slots can only grow until the next push, so a producer that needs
+    // to write several related elements can check for room once and then push them all.
+    size_t writeAvailable() const
+    {
+        return slots.size() - (tail.value.load(std::memory_order_relaxed) - head.value.load(std::memory_order_acquire));
+    }
+
+    // Consumer side. Returns false when the ring is empty.
+    bool pop(T & value)
+    {
+        const size_t h = head.value.load(std::memory_order_relaxed);
+        if (h == tail.value.load(std::memory_order_acquire)) return false;
+        value = slots[h & mask];
+        head.value.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called from a third thread
+    size_t size() const
+    {
+        return tail.value.load(std::memory_order_acquire) - head.value.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+};
+
+} // mm
+
+#endif
@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sysex_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace mm;
+
+SysexHandle & SysexHandle::operator = (SysexHandle && other)
+{
+    if (this == &other) return *this;
+    reset();
+    pool = other.pool; bytes = other.bytes; length = other.length;
+    capacity = other.capacity; sizeClass = other.sizeClass; timestamp = other.timestamp;
+    other.pool = nullptr; other.bytes = nullptr; other.length = 0; other.capacity = 0; other.sizeClass = -1;
+    return *this;
+}
+
+void SysexHandle::append(const uint8_t * data, size_t size)
+{
+    if (!pool) throw std::runtime_error("sysex handle has no pool");
+
+    if (length + size > capacity)
+    {
+        SysexHandle larger;
+        pool->acquireInto(larger, std::max(length + size, capacity * 2));
+        if (length) std::memcpy(larger.bytes, bytes, length);
+        larger.length = length;
+        larger.timestamp = timestamp;
+        *this = std::move(larger);
+    }
+
+    std::memcpy(bytes + length, data, size);
+    length += size;
+}
+
+void SysexHandle::reset()
+{
+    if (pool) pool->release(*this);
+    pool = nullptr; bytes = nullptr; length = 0; capacity = 0; sizeClass = -1;
+}
+
+SysexPool::SysexPool() : SysexPool({ {1024, 16}, {16 * 1024, 8}, {256 * 1024, 2}, {1024 * 1024, 1} }) { }
+
+SysexPool::SysexPool(const std::vector<std::pair<size_t, size_t>> & sizeClasses) : misses(0)
+{
+    busy.clear();
+
+    auto sorted = sizeClasses;
+    std::sort(sorted.begin(), sorted.end());
+
+    for (const auto & c : sorted)
+    {
+        if (c.first == 0) throw std::invalid_argument("sysex buffer size must be positive");
+        SizeClass sc;
+        sc.size = c.first;
+        for (size_t i = 0; i < c.second; ++i)
+        {
+            sc.storage.emplace_back(new uint8_t[c.first]);
+            sc.free.push_back(sc.storage.back().get());
+        }
+        classes.push_back(std::move(sc));
+    }
+}
+
+SysexHandle SysexPool::acquire(size_t bytes)
+{
+    SysexHandle handle;
+    acquireInto(handle, bytes);
+    return handle;
+}
+
+void SysexPool::acquireInto(SysexHandle & handle, size_t bytes)
+{
+    handle.reset();
+    handle.pool = this;
+
+    lock();
+    for (size_t i = 0; i < classes.size(); ++i)
+    {
+        SizeClass & c = classes[i];
+        if (c.size < bytes || c.free.empty()) continue;
+        handle.bytes = c.free.back();
+        handle.capacity = c.size;
+        handle.sizeClass = int(i);
+        c.free.pop_back();
+        break;
+    }
+    unlock();
+
+    if (!handle.bytes)
+    {
+        ++misses;
+        handle.bytes = new uint8_t[bytes];
+        handle.capacity = bytes;
+        handle.sizeClass = -1;
+    }
+}
+
+void SysexPool::release(SysexHandle & handle)
+{
+    if (handle.sizeClass < 0)
+    {
+        delete [] handle.bytes;
+        return;
+    }
+
+    lock();
+    classes[handle.sizeClass].free.push_back(handle.bytes); // never exceeds its initial size, so no allocation
+    unlock();
+}
+
+size_t SysexPool::freeBuffers()
+{
+    lock();
+    size_t n = 0;
+    for (const auto & c : classes) n += c.free.size();
+    unlock();
+    return n;
+}
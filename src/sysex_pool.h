@@ -0,0 +1,128 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#ifndef MODERNMIDI_SYSEX_POOL_H
+#define MODERNMIDI_SYSEX_POOL_H
+
+#include "modernmidi.h"
+#include "midi_message.h"
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+namespace mm
+{
+
+class SysexPool;
+
+// Move-only ownership of one pooled buffer holding a sysex message. The buffer goes back
+// to its pool when the handle is destroyed or reset, from any thread. The pool must
+// outlive its handles.
+class SysexHandle
+{
+    friend class SysexPool;
+
+    SysexPool * pool = nullptr;
+    uint8_t * bytes = nullptr;
+    size_t length = 0;
+    size_t capacity = 0;
+    int sizeClass = -1; // -1: allocated outside the pool
+
+public:
+
+    MidiNanos timestamp = 0;
+
+    SysexHandle() {}
+    ~SysexHandle() { reset(); }
+
+    SysexHandle(SysexHandle && other) { *this = std::move(other); }
+    SysexHandle & operator = (SysexHandle && other);
+
+    SysexHandle(const SysexHandle &) = delete;
+    SysexHandle & operator = (const SysexHandle &) = delete;
+
+    const uint8_t * data() const { return bytes; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    explicit operator bool() const { return bytes != nullptr; }
+
+    MidiMessageView view() const { return MidiMessageView(bytes, length, timestamp); }
+
+    // Appends bytes, moving to a larger buffer from the pool if needed
+    void append(const uint8_t * data, size_t size);
+
+    // Returns the buffer to the pool now
+    void reset();
+};
+
+// Preallocated sysex buffers in a few size classes, so reassembling large dumps doesn't
+// touch the allocator. acquire() takes the smallest free buffer that fits; a message that
+// outgrows it moves up a class. When no pooled buffer is big enough or free, a heap buffer
+// stands in and is counted as a miss. Buffers are handed out and returned under a spin
+// lock held for a few instructions.
+class SysexPool
+{
+    friend class SysexHandle;
+
+    struct SizeClass
+    {
+        size_t size;
+        std::vector<std::unique_ptr<uint8_t[]>> storage;
+        std::vector<uint8_t *> free;
+    };
+
+    std::vector<SizeClass> classes;
+    std::atomic_flag busy;
+    std::atomic<uint64_t> misses;
+
+    void lock() { while (busy.test_and_set(std::memory_order_acquire)) {} }
+    void unlock() { busy.clear(std::memory_order_release); }
+
+    void acquireInto(SysexHandle & handle, size_t bytes);
+    void release(SysexHandle & handle);
+
+public:
+
+    // (buffer size, buffer count) per class. The default holds 16 x 1 KB, 8 x 16 KB,
+    // 2 x 256 KB and 1 x 1 MB, about 1.7 MB in all.
+    SysexPool();
+    SysexPool(const std::vector<std::pair<size_t, size_t>> & sizeClasses);
+
+    SysexPool(const SysexPool &) = delete;
+    SysexPool & operator = (const SysexPool &) = delete;
+
+    SysexHandle acquire(size_t bytes);
+
+    // Buffers that had to come from the heap because the pool had nothing suitable
+    uint64_t getMissCount() const { return misses; }
+    size_t freeBuffers();
+};
+
+} // mm
+
+#endif
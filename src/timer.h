@@ -122,6 +122,57 @@ public:
     }
 };
 
+#elif defined(MM_PLATFORM_POSIX)
+#include <time.h>
+#include <stdint.h>
+
+class PlatformTimer
+{
+    timespec start_timestamp;
+    timespec stop_timestamp;
+
+    static double seconds_between(const timespec & a, const timespec & b)
+    {
+        return double(b.tv_sec - a.tv_sec) + double(b.tv_nsec - a.tv_nsec) * 1e-9;
+    }
+
+public:
+    PlatformTimer()
+    {
+        start_timestamp.tv_sec = stop_timestamp.tv_sec = 0;
+        start_timestamp.tv_nsec = stop_timestamp.tv_nsec = 0;
+    }
+    
+    virtual ~PlatformTimer() {}
+    
+    void start()
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start_timestamp);
+    }
+    
+    void stop()
+    {
+        clock_gettime(CLOCK_MONOTONIC, &stop_timestamp);
+    }
+    
+    double running_time_ms() const
+    {
+        return running_time_s() * 1000;
+    }
+    
+    double running_time_s() const
+    {
+        timespec tmp;
+        clock_gettime(CLOCK_MONOTONIC, &tmp);
+        return seconds_between(start_timestamp, tmp);
+    }
+    
+    double diff_ms() const
+    {
+        return seconds_between(start_timestamp, stop_timestamp) * 1000;
+    }
+};
+
 #else
     #error Unimplemented timer for desired platform
 #endif
@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Standalone checks for ConcurrentQueue. Build and run; a non-zero exit status means a
+// check failed.
+
+#include "concurrent_queue.h"
+#include <vector>
+#include <cstdio>
+
+static int failures = 0;
+
+static void Check(bool condition, const char * what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+static void BulkPushAndDrain()
+{
+    ConcurrentQueue<int> queue;
+
+    std::vector<int> out;
+    Check(queue.drain_into(out) == 0 && out.empty(), "draining an empty queue moves nothing");
+
+    const std::vector<int> values = { 1, 2, 3, 4, 5 };
+    queue.push_bulk(values.begin(), values.end());
+    queue.push_bulk(values.end(), values.end());
+    Check(queue.size() == 5, "a bulk push adds every element and an empty range adds none");
+
+    Check(queue.drain_into(out, 2) == 2, "drain_into stops at max");
+    Check(out == std::vector<int>({ 1, 2 }), "in push order");
+
+    Check(queue.drain_into(out) == 3, "the rest drains by default");
+    Check(out == std::vector<int>({ 1, 2, 3, 4, 5 }), "appended after what was already there");
+    Check(queue.empty(), "nothing is left behind");
+}
+
+static void WaitForTimesOutAndWakes()
+{
+    ConcurrentQueue<int> queue;
+    int value = 0;
+
+    const auto before = std::chrono::steady_clock::now();
+    Check(!queue.wait_for(value, std::chrono::milliseconds(20)), "wait_for fails on an empty queue");
+    Check(std::chrono::steady_clock::now() - before >= std::chrono::milliseconds(20), "after the full timeout");
+
+    // No spinning, so the consumer has to be woken from the condition variable
+    queue.set_max_spin(0);
+    std::thread producer([&]
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        queue.push(42);
+    });
+
+    Check(queue.wait_for(value, std::chrono::seconds(5)), "wait_for wakes when an element arrives");
+    Check(value == 42, "and pops it");
+    producer.join();
+
+    std::vector<int> out;
+    queue.push(7);
+    Check(queue.wait_for_and_drain_into(out, std::chrono::milliseconds(1)) == 1 && out.back() == 7, "timed drain returns what is already queued");
+}
+
+int main()
+{
+    BulkPushAndDrain();
+    WaitForTimesOutAndWakes();
+    if (failures == 0) std::printf("all concurrent queue checks passed\n");
+    return failures ? 1 : 0;
+}
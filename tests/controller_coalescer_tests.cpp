@@ -0,0 +1,120 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Standalone checks for ControllerCoalescer's rate cap and flush order, driven with
+// explicit timestamps. Build and run; a non-zero exit status means a check failed.
+
+#include "controller_coalescer.h"
+#include <vector>
+#include <cstdio>
+
+using namespace mm;
+
+static int failures = 0;
+
+static void Check(bool condition, const char * what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+struct Emitted
+{
+    std::vector<std::vector<uint8_t>> bytes;
+    std::vector<MidiNanos> timestamps;
+
+    void operator()(const MidiMessageView & v)
+    {
+        bytes.push_back(std::vector<uint8_t>(v.data, v.data + v.size));
+        timestamps.push_back(v.timestamp);
+    }
+};
+
+static void Feed(ControllerCoalescer & coalescer, Emitted & out, MidiNanos t, std::vector<uint8_t> bytes)
+{
+    coalescer.process(MidiMessageView(bytes.data(), bytes.size(), t), out);
+}
+
+static void RateCapsEachSlot()
+{
+    ControllerCoalescer coalescer(10);
+    Emitted out;
+
+    Feed(coalescer, out, 0, { 0xB0, 7, 1 });
+    Check(out.bytes.size() == 1, "the first change after a quiet window goes straight through");
+
+    Feed(coalescer, out, 2, { 0xB0, 7, 2 });
+    Feed(coalescer, out, 4, { 0xB0, 7, 3 });
+    Feed(coalescer, out, 5, { 0xB0, 10, 64 });
+    Feed(coalescer, out, 6, { 0xE0, 0, 64 });
+    Check(out.bytes.size() == 3, "changes inside the window are held per slot");
+    Check(coalescer.getCoalescedCount() == 1, "a held value replaced by a later one is counted");
+
+    Check(coalescer.flushDue(9, out) == 0, "nothing leaves before the slot's window ends");
+    Check(coalescer.flushDue(10, out) == 1, "the held value leaves once it does");
+    Check(out.bytes.back() == std::vector<uint8_t>({ 0xB0, 7, 3 }) && out.timestamps.back() == 4, "with the latest value and its own timestamp");
+
+    Feed(coalescer, out, 12, { 0xB0, 7, 4 });
+    Check(out.bytes.size() == 4, "the emitted value starts a new window for its slot");
+}
+
+static void NotesSeeTheControllersBeforeThem()
+{
+    ControllerCoalescer coalescer(100);
+    Emitted out;
+
+    Feed(coalescer, out, 0, { 0xB0, 1, 0 });
+    Feed(coalescer, out, 0, { 0xB1, 1, 0 });
+    Feed(coalescer, out, 0, { 0xB0, 64, 0 });
+    Feed(coalescer, out, 1, { 0xB0, 64, 127 });
+    Feed(coalescer, out, 2, { 0xB1, 1, 50 });
+    Feed(coalescer, out, 3, { 0xB0, 1, 90 });
+    out.bytes.clear();
+
+    Feed(coalescer, out, 4, { 0xF8 });
+    Check(out.bytes.size() == 1 && out.bytes[0][0] == 0xF8, "system messages pass without flushing anything");
+
+    Feed(coalescer, out, 5, { 0x90, 60, 100 });
+    Check(out.bytes.size() == 4, "a note flushes the held values of its channel only");
+    if (out.bytes.size() == 4)
+    {
+        Check(out.bytes[1] == std::vector<uint8_t>({ 0xB0, 64, 127 }), "in the order they were first held");
+        Check(out.bytes[2] == std::vector<uint8_t>({ 0xB0, 1, 90 }), "with their latest values");
+        Check(out.bytes[3][0] == 0x90, "before the note itself");
+    }
+
+    Check(coalescer.flush(5, out) == 1 && out.bytes.back() == std::vector<uint8_t>({ 0xB1, 1, 50 }), "the other channel stays held until flushed");
+}
+
+int main()
+{
+    RateCapsEachSlot();
+    NotesSeeTheControllersBeforeThem();
+    if (failures == 0) std::printf("all controller coalescer checks passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Standalone checks for MidiFilter's compiled action table. Messages go straight through
+// process(), so no MIDI device is needed. Build with the library sources and run; a
+// non-zero exit status means a check failed.
+
+#include "midi_filter.h"
+#include <cstdio>
+
+using namespace mm;
+
+static int failures = 0;
+
+static void Check(bool condition, const char * what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+// Runs one message through the filter; `out` is only meaningful when it returns true
+static bool Run(const MidiFilter & filter, const MidiMessage & msg, MidiMessageView & out, uint8_t (&scratch)[3])
+{
+    return filter.process(MidiMessageView(msg), out, scratch);
+}
+
+static void FirstMatchingRuleWins()
+{
+    std::vector<MidiFilterRule> rules;
+    rules.push_back(MidiFilterRule().type(MessageType::NOTE_ON).channel(10).drop());
+    rules.push_back(MidiFilterRule().type(MessageType::NOTE_ON).type(MessageType::NOTE_OFF).transpose(12));
+    rules.push_back(MidiFilterRule().type(MessageType::CONTROL_CHANGE).range(64, 64).drop());
+    rules.push_back(MidiFilterRule().channels(2, 3).toChannel(5));
+    const MidiFilter filter(rules);
+
+    MidiMessageView out;
+    uint8_t scratch[3];
+
+    Check(!Run(filter, MakeNoteOn(10, 60, 100), out, scratch), "drums are dropped before the transpose rule sees them");
+
+    Check(Run(filter, MakeNoteOn(1, 60, 100), out, scratch), "other notes pass");
+    Check(out.data == scratch && out.data[1] == 72 && out.data[2] == 100, "transposed into the scratch buffer");
+    Check(Run(filter, MakeNoteOff(1, 60, 0), out, scratch) && out.data[1] == 72, "note offs follow their note ons");
+    Check(!Run(filter, MakeNoteOn(1, 120, 100), out, scratch), "notes pushed past 127 are dropped");
+
+    Check(!Run(filter, MakeControlChange(1, 64, 127), out, scratch), "the data range selects sustain");
+    const MidiMessage volume = MakeControlChange(1, 7, 100);
+    Check(Run(filter, volume, out, scratch) && out.data == volume.data.data(), "unmatched messages pass without a copy");
+
+    Check(Run(filter, MakeProgramChange(3, 4), out, scratch) && out.data[0] == 0xC4 && out.data[1] == 4, "channels 2-3 are remapped to 5");
+    Check(Run(filter, MakeProgramChange(4, 4), out, scratch) && out.data[0] == 0xC3, "channel 4 is outside the range");
+
+    const MidiMessage clock(std::vector<uint8_t>{ 0xF8 });
+    Check(Run(filter, clock, out, scratch) && out.size == 1 && out.data[0] == 0xF8, "system messages ignore channel criteria and pass unchanged");
+}
+
+static void QueuedAndDroppedActions()
+{
+    SpscRing<QueuedMidiMessage> queue(2);
+
+    std::vector<MidiFilterRule> rules;
+    rules.push_back(MidiFilterRule().type(MessageType::CONTROL_CHANGE).toChannel(2).queueTo(queue));
+    rules.push_back(MidiFilterRule().type(MessageType::PROGRAM_CHANGE).queueTo(queue).pass());
+    rules.push_back(MidiFilterRule().type(MessageType::SYSTEM_EXCLUSIVE).queueTo(queue));
+    const MidiFilter filter(rules);
+
+    MidiMessageView out;
+    uint8_t scratch[3];
+
+    Check(!Run(filter, MakeControlChange(1, 7, 90), out, scratch), "queued messages don't reach the callbacks");
+    Check(Run(filter, MakeProgramChange(1, 9), out, scratch), "unless the rule also passes them");
+
+    QueuedMidiMessage q;
+    Check(queue.pop(q) && q.size == 3 && q.data[0] == 0xB1 && q.data[2] == 90, "the queue gets the rewritten message");
+    Check(queue.pop(q) && q.size == 2 && q.data[0] == 0xC0 && q.data[1] == 9, "in order");
+
+    Run(filter, MakeControlChange(1, 1, 1), out, scratch);
+    Run(filter, MakeControlChange(1, 1, 2), out, scratch);
+    Run(filter, MakeControlChange(1, 1, 3), out, scratch);
+    Check(filter.droppedMessages() == 1, "a full queue counts a drop");
+
+    const MidiMessage sysex(std::vector<uint8_t>{ 0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7 });
+    Run(filter, sysex, out, scratch);
+    Check(filter.droppedMessages() == 2, "sysex doesn't fit a queued message and counts a drop");
+
+    MidiOutput closed("midi-filter-closed-output");
+    std::vector<MidiFilterRule> forward;
+    forward.push_back(MidiFilterRule().forwardTo(closed));
+    const MidiFilter forwarding(forward);
+    Check(!Run(forwarding, MakeNoteOn(1, 60, 100), out, scratch), "forwarded messages don't reach the callbacks");
+    Check(forwarding.droppedMessages() == 1, "forwarding to a closed output counts a drop instead of throwing");
+}
+
+int main()
+{
+    FirstMatchingRuleWins();
+    QueuedAndDroppedActions();
+    if (failures == 0) std::printf("all midi filter checks passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Standalone checks for MidiInputAggregator's reorder buffer. Messages are fed straight
+// into each input's private handler with chosen arrival times, as the driver callback
+// would, and released with explicit poll times, so the checks are deterministic and need
+// no MIDI device. Build with the library sources and run; a non-zero exit status means a
+// check failed.
+
+#include "modernmidi.h"
+#include "midi_message.h"
+#include "realtime_thread.h"
+#include "spsc_ring.h"
+#include "controller_coalescer.h"
+#include "sysex_pool.h"
+#include "midi_filter.h"
+
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <cstdio>
+
+// The handler is private
+#define class struct
+#include "midi_input.h"
+#undef class
+
+#include "midi_input_aggregator.h"
+
+using namespace mm;
+
+static int failures = 0;
+
+static void Check(bool condition, const char * what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+static void Feed(MidiInput & input, MidiNanos arrival, uint8_t note)
+{
+    std::vector<uint8_t> bytes = { 0x90, note, 100 };
+    input.handleMessage(arrival, 0, &bytes);
+}
+
+static void ReleasesInTimestampOrder()
+{
+    MidiInput a("aggregator-a"), b("aggregator-b");
+    MidiInputAggregator aggregator(50);
+    aggregator.addInput(a);
+    aggregator.addInput(b);
+
+    Feed(a, 100, 1);
+    Feed(b, 50, 2);
+    Feed(a, 50, 3);
+    Feed(a, 50, 4);
+
+    AggregatedMidiMessage out[8];
+    Check(aggregator.poll(out, 8, 90) == 0, "nothing is released inside the window");
+
+    size_t n = aggregator.poll(out, 8, 120);
+    Check(n == 3, "messages older than the window are released");
+    if (n == 3)
+    {
+        Check(out[0].port == 0 && out[0].msg.data[1] == 3, "equal timestamps go by port");
+        Check(out[1].port == 0 && out[1].msg.data[1] == 4, "then by arrival");
+        Check(out[2].port == 1 && out[2].msg.data[1] == 2, "before the next port");
+    }
+
+    n = aggregator.poll(out, 1, 150);
+    Check(n == 1 && out[0].msg.timestamp == 100, "the rest once its window closes");
+
+    Feed(b, 80, 5);
+    n = aggregator.poll(out, 8, 200);
+    Check(n == 1 && out[0].msg.data[1] == 5, "a message behind the released ones still comes out");
+    Check(aggregator.getLateCount() == 1, "and is counted as late");
+}
+
+static void FullBufferReleasesOldestEarly()
+{
+    MidiInput input("aggregator-full");
+    MidiInputAggregator aggregator(1000, 2);
+    aggregator.addInput(input);
+
+    Feed(input, 30, 1);
+    Feed(input, 10, 2);
+    Feed(input, 20, 3);
+
+    // The buffer holds 30 and 10, gives up 10, refills from the ring with 20 and is full
+    // again, so gives up 20; 30 then has room to wait out its window
+    AggregatedMidiMessage out[8];
+    const size_t n = aggregator.poll(out, 8, 0);
+    Check(n == 2 && out[0].msg.timestamp == 10 && out[1].msg.timestamp == 20, "a full buffer gives up its oldest entries inside the window");
+
+    Check(aggregator.flush(out, 8) == 1 && out[0].msg.timestamp == 30, "flush releases the rest");
+    Check(aggregator.getLateCount() == 0, "early releases aren't late");
+}
+
+int main()
+{
+    ReleasesInTimestampOrder();
+    FullBufferReleasesOldestEarly();
+    if (failures == 0) std::printf("all input aggregator checks passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Standalone checks for the integer tick / nanosecond timeline. Build with
+// src/midi_time.cpp and run; a non-zero exit status means a check failed.
+
+#include "midi_time.h"
+#include <stdexcept>
+#include <cstdio>
+
+using namespace mm;
+
+static int failures = 0;
+
+static void Check(bool condition, const char * what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+// 120 bpm for two beats, then 60 bpm
+static TempoMap TwoTempos()
+{
+    TempoMap map(480, 120);
+    map.addTempoChange(960, 1000000);
+    return map;
+}
+
+static void ConvertsAcrossATempoChange()
+{
+    const TempoMap map = TwoTempos();
+
+    Check(map.nanosAt(0) == 0, "the timeline starts at zero");
+    Check(map.nanosAt(480) == NanosPerSecond / 2, "one beat at 120 bpm");
+    Check(map.nanosAt(960) == NanosPerSecond, "the change lands at the end of the first segment");
+    Check(map.nanosAt(1200) == 3 * NanosPerSecond / 2, "half a beat at 60 bpm");
+    Check(map.nanosAt(1440) == 2 * NanosPerSecond, "one beat at 60 bpm");
+
+    Check(map.tickAt(NanosPerSecond / 2) == 480, "nanos to ticks before the change");
+    Check(map.tickAt(3 * NanosPerSecond / 2) == 1200, "nanos to ticks after the change");
+    Check(map.tickAt(NanosPerSecond - 1) == 959, "tickAt returns the last tick at or before the time");
+
+    Check(map.beatsPerMinuteAt(959) == 120 && map.beatsPerMinuteAt(960) == 60, "tempo lookup switches at the change");
+}
+
+static void CursorMatchesRandomAccess()
+{
+    const TempoMap map = TwoTempos();
+    TempoMap::Cursor cursor(map);
+
+    bool matches = true;
+    for (MidiTick tick = 0; tick < 3000; tick += 7)
+        matches = matches && cursor.nanosAt(tick) == map.nanosAt(tick);
+    Check(matches, "a sequential walk agrees with the binary search");
+    Check(cursor.nanosAt(480) == map.nanosAt(480), "a cursor moved backwards starts over");
+}
+
+static void EditsAndPrecision()
+{
+    TempoMap map(480, 120);
+    map.addTempoChange(960, 1000000);
+    map.addTempoChange(960, 250000);
+    Check(map.beatsPerMinuteAt(960) == 240, "a change at the same tick replaces the previous one");
+
+    bool threw = false;
+    try { map.addTempoChange(480, 500000); }
+    catch (const std::invalid_argument &) { threw = true; }
+    Check(threw, "tempo changes out of tick order are rejected");
+
+    const TempoMap hour(480, 120);
+    Check(hour.nanosAt(480 * 2 * 3600) == 3600 * NanosPerSecond, "an hour of ticks converts exactly");
+    Check(hour.tickAt(3600 * NanosPerSecond) == 480 * 2 * 3600, "and back");
+}
+
+int main()
+{
+    ConvertsAcrossATempoChange();
+    CursorMatchesRandomAccess();
+    EditsAndPrecision();
+    if (failures == 0) std::printf("all midi time checks passed\n");
+    return failures ? 1 : 0;
+}
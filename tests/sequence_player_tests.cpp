@@ -0,0 +1,178 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Standalone checks for MidiSequencePlayer, driven by a ManualSequencerClock so they run
+// deterministically without a MIDI device. Build with the library sources and run; a
+// non-zero exit status means a check failed.
+
+#include "sequence_player.h"
+#include <cstdio>
+
+using namespace mm;
+
+static int failures = 0;
+
+static void Check(bool condition, const char * what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+// Seeking past the end of a loop region must land at the same phase inside it rather
+// than scheduling whole iterations in the past
+static void SeekPastLoopEnd()
+{
+    MidiOutput output("seek-past-loop-end");
+    output.openPort(0);
+
+    MidiTrack track;
+    for (int i = 0; i < 12; ++i)
+        track.push_back(std::make_shared<TrackEvent>(i ? 480 : 0, 0, std::make_shared<MidiMessage>(MakeNoteOn(1, 60, 100))));
+
+    ManualSequencerClock clock;
+    MidiSequencePlayer player(output);
+    player.loadSingleTrack(track, 480, 120); // 960 ticks per second
+    player.realtimeConfig.priority = ThreadPriority::NORMAL;
+    player.setClock(&clock);
+    player.setLooping(true);
+    player.setLoopRegion(0, 1920);
+    player.seekToTick(4800); // same phase as tick 960
+    player.start();
+
+    clock.waitForIdle();
+    Check(player.getTimingStats().lateness.count == 1, "only the chased note is sent at the seek point");
+
+    for (int i = 0; i < 8; ++i)
+    {
+        clock.advance(NanosPerSecond / 4);
+        clock.waitForIdle();
+    }
+
+    // Notes at 1440, 1920 (wrapped to 0), 2400 and 2880 follow within two seconds
+    const auto stats = player.getTimingStats();
+    Check(stats.lateness.count == 5, "loop iterations after the seek play on time");
+    Check(stats.lateness.max == 0, "nothing is scheduled in the past");
+
+    player.stop();
+}
+
+// The chased state is written into a caller-provided buffer with bank select ahead of
+// the program change it applies to
+static void ChaseCollectsState()
+{
+    MidiChaseState state;
+    state.apply(MakeControlChange(2, 7, 100));
+    state.apply(MakeProgramChange(2, 5));
+    state.apply(MakeControlChange(2, 0, 1));
+    state.apply(MakePitchBend(1, 0x2001));
+
+    std::vector<QueuedMidiMessage> out(MidiChaseState::MaxCollected);
+    const size_t n = state.collect(out.data());
+
+    Check(n == 4, "one message per chased value");
+    if (n != 4) return;
+
+    Check(out[0].size == 3 && out[0].data[0] == 0xE0 && out[0].data[1] == 0x01 && out[0].data[2] == 0x40, "pitch bend on channel 1");
+    Check(out[1].size == 3 && out[1].data[0] == 0xB1 && out[1].data[1] == 0 && out[1].data[2] == 1, "bank select first on channel 2");
+    Check(out[2].size == 2 && out[2].data[0] == 0xC1 && out[2].data[1] == 5, "then the program change");
+    Check(out[3].size == 3 && out[3].data[0] == 0xB1 && out[3].data[1] == 7 && out[3].data[2] == 100, "then the remaining controllers");
+}
+
+// Time positions follow the tempo map of whatever snapshot was published last, not the
+// one loadSingleTrack built
+static void LengthFollowsPublishedSnapshot()
+{
+    MidiOutput output("length-follows-published-snapshot");
+    MidiSequencePlayer player(output);
+
+    MidiTrack track;
+    track.push_back(std::make_shared<TrackEvent>(960, 0, std::make_shared<MidiMessage>(MakeNoteOn(1, 60, 100))));
+    player.loadSingleTrack(track, 480, 120);
+    Check(player.length() == NanosPerSecond, "a loaded track is timed at its tempo");
+
+    std::unique_ptr<MidiSequenceSnapshot> slower = player.copySequence();
+    slower->beatsPerMinute = 60;
+    slower->tempoMap = TempoMap(480, 60);
+    player.publish(std::move(slower));
+    Check(player.length() == 2 * NanosPerSecond, "a published snapshot brings its own tempo map");
+}
+
+// Offline rendering schedules like run(): from a pending seek, with the chased state
+// first, and on into queued sequences at their own resolution and tempo
+static void RenderFollowsPlayback()
+{
+    MidiOutput output("render-follows-playback");
+    MidiSequencePlayer player(output);
+
+    MidiTrack track;
+    track.push_back(std::make_shared<TrackEvent>(0, 0, std::make_shared<MidiMessage>(MakeControlChange(1, 7, 90))));
+    for (int i = 0; i < 3; ++i)
+        track.push_back(std::make_shared<TrackEvent>(i ? 480 : 0, 0, std::make_shared<MidiMessage>(MakeNoteOn(1, 60, 100))));
+    player.loadSingleTrack(track, 480, 120); // notes at 0, 0.5 and 1 s; ends at tick 960
+
+    std::unique_ptr<MidiSequenceSnapshot> next(new MidiSequenceSnapshot());
+    next->ticksPerBeat = 960;
+    next->beatsPerMinute = 60;
+    next->tempoMap = TempoMap(960, 60);
+    next->events.push_back(MidiPlayerEvent(0, 0, std::make_shared<MidiMessage>(MakeNoteOn(1, 62, 100)), 0));
+    next->events.push_back(MidiPlayerEvent(0, 960, std::make_shared<MidiMessage>(MakeNoteOn(1, 64, 100)), 0));
+    next->endTick = 960;
+    next->buildChaseSnapshots();
+    Check(player.enqueue(next), "the next sequence is queued");
+
+    player.seekToTick(480);
+
+    std::vector<MidiPlayerEvent> rendered;
+    player.render([&](const MidiPlayerEvent & ev) { rendered.push_back(ev); });
+
+    Check(rendered.size() == 5, "chased controller, two remaining notes and the queued sequence");
+    if (rendered.size() != 5) return;
+
+    Check(rendered[0].trackIdx == -1 && rendered[0].timestamp == 0 && (*rendered[0].msg)[1] == 7, "chased state comes first");
+    Check(rendered[1].timestamp == 0, "playback starts at the seek position");
+    Check(rendered[2].timestamp == NanosPerSecond / 2, "then follows the loaded tempo");
+    Check(rendered[3].timestamp == NanosPerSecond / 2 && (*rendered[3].msg)[1] == 62, "the queued sequence starts where the first one ends");
+    Check(rendered[4].timestamp == 3 * NanosPerSecond / 2, "at its own resolution and tempo");
+    Check(player.queuedSequences() == 0, "rendering consumes the queue");
+
+    player.setLooping(true);
+    bool threw = false;
+    try { player.render([](const MidiPlayerEvent &) {}); }
+    catch (const std::runtime_error &) { threw = true; }
+    Check(threw, "a looping sequence has no end to render to");
+}
+
+int main()
+{
+    SeekPastLoopEnd();
+    ChaseCollectsState();
+    LengthFollowsPublishedSnapshot();
+    RenderFollowsPlayback();
+    if (failures == 0) std::printf("all sequence player checks passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2015, Dimitri Diakopoulos All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Standalone checks for SysexPool: size-class promotion in SysexHandle::append and miss
+// counting when the pool runs dry. Build and run; a non-zero exit status means a check failed.
+
+#include "sysex_pool.h"
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+
+using namespace mm;
+
+static int failures = 0;
+
+static void Check(bool condition, const char * what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+static void AppendMovesUpAClass()
+{
+    SysexPool pool({ {4, 2}, {16, 1} });
+    Check(pool.freeBuffers() == 3, "every pooled buffer starts free");
+
+    const uint8_t dump[] = { 0xF0, 0x7E, 0x00, 0x06, 0x02, 0x41, 0x10, 0x42, 0x12, 0x40,
+                             0x00, 0x7F, 0x00, 0x41, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                             0x07, 0x08, 0x09, 0x0A, 0xF7 };
+
+    SysexHandle handle = pool.acquire(3);
+    handle.timestamp = 1234;
+    Check(bool(handle) && pool.freeBuffers() == 2, "a small request takes the smallest class");
+
+    handle.append(dump, 3);
+    handle.append(dump + 3, 2);
+    Check(handle.size() == 5 && std::memcmp(handle.data(), dump, 5) == 0, "bytes survive the move to a larger class");
+    Check(handle.timestamp == 1234, "so does the timestamp");
+    Check(pool.freeBuffers() == 2, "the outgrown buffer goes back to the pool");
+    Check(pool.getMissCount() == 0, "promotion within the pool is not a miss");
+
+    handle.append(dump + 5, sizeof(dump) - 5);
+    Check(handle.size() == sizeof(dump) && std::memcmp(handle.data(), dump, sizeof(dump)) == 0, "a message larger than every class still reassembles");
+    Check(pool.getMissCount() == 1, "and the heap buffer it needed is counted as a miss");
+    Check(pool.freeBuffers() == 3, "leaving the pooled buffers free");
+
+    handle.reset();
+    Check(!handle && pool.freeBuffers() == 3, "releasing a heap buffer doesn't add to the pool");
+}
+
+static void ExhaustionCountsMisses()
+{
+    SysexPool pool({ {16, 1}, {4, 2} });
+
+    SysexHandle a = pool.acquire(4);
+    SysexHandle b = pool.acquire(4);
+    SysexHandle c = pool.acquire(4);
+    Check(pool.freeBuffers() == 0 && pool.getMissCount() == 0, "a full class falls through to a larger one");
+
+    SysexHandle d = pool.acquire(1);
+    Check(bool(d) && pool.getMissCount() == 1, "an empty pool hands out a heap buffer and counts it");
+
+    SysexHandle e = pool.acquire(32);
+    Check(bool(e) && pool.getMissCount() == 2, "so does a request larger than every class");
+
+    b = std::move(d);
+    Check(pool.freeBuffers() == 1, "move assignment returns the overwritten buffer");
+
+    a.reset(); c.reset();
+    Check(pool.freeBuffers() == 3, "every pooled buffer comes back");
+
+    bool threw = false;
+    try { SysexHandle().append(a.data(), 0); }
+    catch (const std::runtime_error &) { threw = true; }
+    Check(threw, "appending to a handle without a pool throws");
+}
+
+int main()
+{
+    AppendMovesUpAClass();
+    ExhaustionCountsMisses();
+    if (failures == 0) std::printf("all sysex pool checks passed\n");
+    return failures ? 1 : 0;
+}